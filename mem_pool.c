@@ -5,6 +5,14 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h> // for perror()
+#include <limits.h> // for UINT_MAX
+#include <stdint.h> // for uint64_t
+#include <string.h> // for memcpy()
+#include <stdatomic.h> // for the thread cache counters
+#ifdef MEM_POOL_THREAD_SAFE
+#include <pthread.h>
+#include <sched.h> // for sched_yield()
+#endif
 
 #include "mem_pool.h"
 
@@ -13,20 +21,56 @@
 /* Constants */
 /*           */
 /*************/
-static const float      MEM_FILL_FACTOR                 = 0.75;
-static const unsigned   MEM_EXPAND_FACTOR               = 2;
+static const unsigned   MEM_POOL_STORE_INIT_CAPACITY    = 20; // slots in the first chunk
+static const unsigned   MEM_POOL_STORE_EXPAND_FACTOR    = 2;  // for each chunk after it
+static const unsigned   MEM_POOL_STORE_NIL              = UINT_MAX; // not in the store
+#define                 MEM_POOL_STORE_MAX_CHUNKS       26 // so fewer than 2^31 slots
 
-static const unsigned   MEM_POOL_STORE_INIT_CAPACITY    = 20;
-static const float      MEM_POOL_STORE_FILL_FACTOR      = 0.75;
-static const unsigned   MEM_POOL_STORE_EXPAND_FACTOR    = 2;
+static const unsigned   MEM_NODE_HEAP_CHUNK_CAPACITY    = 256; // nodes per chunk
+static const unsigned   MEM_NODE_HEAP_EXPAND_FACTOR     = 2;   // for the chunk table
 
-static const unsigned   MEM_NODE_HEAP_INIT_CAPACITY     = 40;
-static const float      MEM_NODE_HEAP_FILL_FACTOR       = 0.75;
-static const unsigned   MEM_NODE_HEAP_EXPAND_FACTOR     = 2;
+static const unsigned   MEM_CHUNK_IX_INIT_CAPACITY      = 16; // a power of two
+static const float      MEM_CHUNK_IX_FILL_FACTOR        = 0.5;
+static const unsigned   MEM_CHUNK_IX_EXPAND_FACTOR      = 2;
 
 static const unsigned   MEM_GAP_IX_INIT_CAPACITY        = 40;
 static const float      MEM_GAP_IX_FILL_FACTOR          = 0.75;
 static const unsigned   MEM_GAP_IX_EXPAND_FACTOR        = 2;
+static const unsigned   MEM_GAP_IX_NIL                  = UINT_MAX; // no gap entry
+
+static const unsigned   MEM_PAGE_MAP_SHIFT              = 12; // 4 KiB pages
+static const unsigned   MEM_PAGE_MAP_GRANULE_SHIFT      = 7;  // 128-byte granules of a page
+
+static const size_t     MEM_COMPACT_AUTO_BUDGET         = 64 * 1024; // most work per free
+
+static const unsigned   MEM_EXTENT_EXPAND_FACTOR        = 2;  // for the extent table
+static const unsigned   MEM_EXTENT_NIL                  = UINT_MAX; // no extent
+
+static const size_t     MEM_THREAD_CACHE_CLASS_SIZE     = 16; // size class step
+#define                 MEM_THREAD_CACHE_CLASS_COUNT    64 // so up to 1 KiB is cached
+#define                 MEM_THREAD_CACHE_MAX_THREADS    64 // threads with a cache at once
+
+#define                 MEM_REMOTE_FREE_CAPACITY        1024 // a power of two
+
+#define                 MEM_SHARD_MAX_LOANS             256 // gaps lent between shards
+
+static const unsigned   MEM_SNAPSHOT_MAX_RETRIES        = 1000; // before a snapshot gives up
+
+static const unsigned   MEM_DEFERRED_INIT_CAPACITY      = 64; // deferred frees queued at first
+static const unsigned   MEM_DEFERRED_EXPAND_FACTOR      = 2;
+
+#define                 MEM_QUICK_LIST_LOG2             6  // lists of freed nodes per pool
+#define                 MEM_QUICK_LIST_COUNT            (1 << MEM_QUICK_LIST_LOG2)
+
+static const size_t     MEM_BUDDY_MIN_BLOCK             = 16;
+
+static const size_t     MEM_TAG_SIZE                    = sizeof(size_t); // header, footer
+static const size_t     MEM_TAG_MIN_BLOCK               = 2 * sizeof(size_t) + 2 * sizeof(char *);
+static const size_t     MEM_TAG_ALLOCATED               = 1; // low bit of a tag
+
+#define                 MEM_GAP_CLASS_COUNT             64 // power-of-two size classes
+#define                 MEM_GAP_SUBCLASS_LOG2           4  // TLSF second-level bits
+#define                 MEM_GAP_SUBCLASS_COUNT          (1 << MEM_GAP_SUBCLASS_LOG2)
 
 
 
@@ -44,21 +88,162 @@ typedef struct _node {
     alloc_t alloc_record;
     unsigned used;
     unsigned allocated;
+    unsigned gap_ix_pos; // position of the gap entry, while a gap
+    unsigned extent_start; // first segment of an extent, never merged with the one before
+    unsigned quick;     // on a quick list: freed, but still allocated until coalesced
+    unsigned cached;    // in a thread cache: freed, but still allocated until handed out
+    unsigned pinned;    // never moved by compaction
+    unsigned align_shift; // log2 of the alignment it was allocated at, kept by realloc
     struct _node *next, *prev; // doubly-linked list for gap deletion
 } node_t, *node_pt;
 
+// the node chunks of a pool, hashed by the chunk-sized spans of memory
+// they lie in, so that a pointer can be found to be a node of the pool
+// without reading it
+// note: a table is only added to, and a larger one replaces it, so it can
+// be read without the lock
+typedef struct _chunk_ix {
+    struct _chunk_ix *retired; // the table it replaced, freed with the pool
+    unsigned capacity;      // a power of two
+    unsigned num_entries;
+    atomic_uintptr_t *spans; // span plus one, 0 for an empty entry
+    node_pt *chunks;
+} chunk_ix_t, *chunk_ix_pt;
+
+typedef struct _extent {
+    char *mem;
+    size_t size;
+    node_pt *page_map;  // page to the node of the segment holding its start
+    node_pt *granule_map; // same by granule, in the first and last page of a segment
+    node_pt first;      // node of the segment at the start of the extent
+    unsigned borrowed;  // lent by another shard, so not freed with the pool
+    unsigned outer;     // the extent it lies in, as borrowed memory may, or MEM_EXTENT_NIL
+} extent_t, *extent_pt;
+
+typedef struct _store_slot {
+    _Atomic(struct _pool_mgr *) mgr; // null while the slot is free
+    atomic_uint next_free;  // next free slot plus one, 0 for none
+} store_slot_t, *store_slot_pt;
+
+typedef struct _shard_loan {
+    atomic_uint seq;        // odd while lent, bumped as it is lent and given back
+    char *mem;
+    size_t size;
+    void *alloc;            // the allocation it is in the lending shard
+    unsigned lender, borrower;
+    unsigned depth;         // 1, or one more than the loan it was lent out of
+} shard_loan_t, *shard_loan_pt;
+
+typedef enum _gap_tree {
+    GAP_TREE_SIZE,  // ordered by (size, mem), for BEST_FIT
+    GAP_TREE_ADDR,  // ordered by mem, augmented with max_size, for FIRST_FIT
+    GAP_TREE_COUNT
+} gap_tree;
+
+typedef struct _gap_link {
+    unsigned left, right; // children in the AVL tree (gap_ix positions)
+    unsigned height;      // height of the subtree rooted at this entry
+} gap_link_t;
+
 typedef struct _gap {
     size_t size;
     node_pt node;
+    gap_link_t link[GAP_TREE_COUNT];
+    size_t max_size;      // largest gap in the GAP_TREE_ADDR subtree
+    unsigned class_prev, class_next; // size class free list (SEGREGATED_FIT, TLSF)
 } gap_t, *gap_pt;
 
+typedef struct _thread_cache {
+    void **blocks;          // a stack of cached handles per size class
+    unsigned count[MEM_THREAD_CACHE_CLASS_COUNT];
+    atomic_size_t hits;     // written by the owning thread only
+    atomic_size_t misses;
+    atomic_size_t frees;    // deallocations into the cache
+    atomic_size_t held;     // the blocks in the cache, and their bytes, for the stats
+    atomic_size_t held_size;
+} thread_cache_t, *thread_cache_pt;
+
+typedef struct _remote_free {
+    atomic_size_t seq;      // the position it is filled for, plus one once filled
+    void *alloc;
+} remote_free_t, *remote_free_pt;
+
 typedef struct _pool_mgr {
     pool_t pool;
     node_pt node_heap;
     unsigned total_nodes;
     unsigned used_nodes;
+    node_pt *node_blocks;   // the node heap grows by fixed-size chunks which never move
+    unsigned num_node_blocks;
+    unsigned node_blocks_capacity;
+    unsigned node_bump;     // nodes of the last chunk from here on were never used
+    node_pt free_nodes;     // released nodes, linked through next
+    _Atomic(chunk_ix_pt) chunk_ix; // the chunks by address, to check a handle
+    extent_pt extents;      // the pool memory, and the memory added as it grew
+    unsigned *extent_order; // the extents by address, each after those it lies in
+    unsigned num_extents;
+    unsigned extents_capacity;
+    unsigned growable;      // adds an extent when no gap fits, instead of failing
     gap_pt gap_ix;
     unsigned gap_ix_capacity;
+    unsigned gap_ix_root[GAP_TREE_COUNT];
+    unsigned gap_class_head[MEM_GAP_CLASS_COUNT * MEM_GAP_SUBCLASS_COUNT];
+    uint64_t gap_class_map; // bit c is set iff class c is non-empty
+    size_t largest_gap;     // no gap is larger, kept as gaps are added and removed
+    unsigned largest_gap_exact; // it is the size of a gap, else found again when asked
+    unsigned largest_gap_count; // gaps of that size, or fewer, while it is exact
+    uint32_t gap_subclass_map[MEM_GAP_CLASS_COUNT]; // same, per subclass
+    size_t slab_slot_size;  // SLAB pools only: no node heap or gap index
+    unsigned slab_count;
+    uint64_t *slab_map;     // bit i is set iff slot i is allocated
+    unsigned slab_free;     // first freed slot, the rest link through the slots
+    unsigned slab_bump;     // slots from here on have never been allocated
+    size_t arena_top;       // ARENA pools only: offset of the first free byte
+    char *tag_class_head[MEM_GAP_CLASS_COUNT]; // BOUNDARY_TAG free lists
+    unsigned cache_capacity; // blocks per class in a thread cache, 0 for none
+    thread_cache_pt *thread_caches; // by thread index, each made on first use
+    size_t cache_hits;      // of the thread caches that were freed
+    size_t cache_misses;
+    struct _pool_mgr **shards; // sharded pools only: the pools they route to
+    unsigned num_shards;
+    size_t shard_size;      // of each shard, without what it borrowed
+    shard_loan_pt loans;    // gaps that one shard lent to another, in reusable slots
+    atomic_uint num_loans;  // slots ever used, so a search stops there
+    unsigned *shard_order;  // the shards by the address of their own memory
+    atomic_uint *slice_loans; // live loans in the own memory of each shard
+    struct _pool_mgr *parent; // shards only: the sharded pool their counts go to
+    size_t reported_alloc_size; // the counts the sharded pool last had from the shard
+    unsigned reported_num_allocs;
+    unsigned reported_num_gaps;
+    unsigned store_slot;    // its slot in the pool store, so closing needs no search
+    atomic_uint snapshot_seq; // odd while a call that holds the lock changes the segments
+    unsigned defer_frees;   // frees are queued, and coalesced as the pool is maintained
+    node_pt *deferred_frees; // nodes freed since, still allocated until then
+    unsigned num_deferred;
+    unsigned deferred_capacity;
+    unsigned quick_capacity; // nodes per quick list, 0 for none
+    node_pt *quick_nodes;   // a stack of freed nodes per list, of a single size each
+    size_t quick_size[MEM_QUICK_LIST_COUNT]; // the size a list holds, while not empty
+    unsigned quick_count[MEM_QUICK_LIST_COUNT];
+    unsigned num_quick;     // nodes on all the lists
+    char *compact_cursor;   // where the next compaction step starts, null for the start
+    float compact_threshold; // share of the free memory outside the largest gap that
+                            // starts a compaction step as memory is freed, 0 for never
+    size_t compact_budget;  // bytes moved by each of those steps, 0 for no limit
+    unsigned gap_histogram[MEM_STATS_GAP_CLASSES]; // gaps per size class, kept with num_gaps
+    size_t peak_alloc_size; // high-water marks, raised as they are passed
+    unsigned peak_used_nodes;
+    size_t total_allocs;    // kept with num_allocs, so the difference is num_allocs
+    size_t total_frees;
+    size_t total_failures;  // allocation calls that returned null
+    size_t remote_failures; // queued deallocations that failed when drained
+#ifdef MEM_POOL_THREAD_SAFE
+    pthread_mutex_t lock;   // guards the pool, taken by every call on it
+    pthread_t owner;        // deallocations by other threads are queued
+    remote_free_pt remote_frees; // bounded queue, filled by any thread
+    atomic_size_t remote_tail;   // next position to fill
+    size_t remote_head;     // next position to drain, under the lock
+#endif
 } pool_mgr_t, *pool_mgr_pt;
 
 
@@ -68,9 +253,18 @@ typedef struct _pool_mgr {
 /* Static global variables */
 /*                         */
 /***************************/
-static pool_mgr_pt *pool_store = NULL; // an array of pointers, only expand
-static unsigned pool_store_size = 0;
-static unsigned pool_store_capacity = 0;
+static _Atomic(store_slot_pt) pool_store[MEM_POOL_STORE_MAX_CHUNKS]; // chunks of slots, which never move
+static atomic_int pool_store_open = 0;   // set from mem_init until mem_free
+static atomic_uint pool_store_size = 0;  // slots ever taken, only grows until mem_free
+static atomic_uint pool_store_count = 0; // pools open
+static atomic_uint_least64_t pool_store_free = 0; // top free slot plus one, with a tag in the high half
+#ifdef MEM_POOL_THREAD_SAFE
+static pthread_mutex_t pool_store_lock = PTHREAD_MUTEX_INITIALIZER; // only for the store
+static uint64_t thread_ix_map = 0; // bit i is set iff a thread has index i, under the store lock
+static pthread_key_t thread_ix_key; // gives up the index of an exiting thread
+static pthread_once_t thread_ix_once = PTHREAD_ONCE_INIT;
+static _Thread_local unsigned thread_ix = 0; // the index of this thread plus one, 0 if none yet
+#endif
 
 
 
@@ -79,8 +273,152 @@ static unsigned pool_store_capacity = 0;
 /* Forward declarations of static functions */
 /*                                          */
 /********************************************/
-static alloc_status _mem_resize_pool_store();
+static store_slot_pt _mem_store_slot(unsigned slot);
+static alloc_status _mem_link_pool_store(pool_mgr_pt pool_mgr);
+static void _mem_release_pool_store(pool_mgr_pt pool_mgr);
+static void _mem_pool_free(pool_mgr_pt pool_mgr);
+static void _mem_store_lock();
+static void _mem_store_unlock();
+static alloc_status _mem_pool_sync_init(pool_mgr_pt pool_mgr);
+static void _mem_pool_sync_destroy(pool_mgr_pt pool_mgr);
+static void _mem_pool_lock(pool_mgr_pt pool_mgr);
+static void _mem_pool_lock_read(pool_mgr_pt pool_mgr);
+static void _mem_pool_change(pool_mgr_pt pool_mgr);
+static void _mem_pool_unlock(pool_mgr_pt pool_mgr);
+static alloc_status _mem_remote_free(pool_mgr_pt pool_mgr, void *alloc);
+static void _mem_drain_remote_frees(pool_mgr_pt pool_mgr);
+static alloc_status _mem_defer_free(pool_mgr_pt pool_mgr, node_pt node);
+static alloc_status _mem_drain_deferred_frees(pool_mgr_pt pool_mgr);
+static alloc_status _mem_free_nodes(pool_mgr_pt pool_mgr, node_pt *nodes, unsigned n);
+static int _mem_gap_indexed(pool_mgr_pt pool_mgr, node_pt node);
+static unsigned _mem_quick_list(size_t size);
+static node_pt _mem_quick_new_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_quick_del_alloc(pool_mgr_pt pool_mgr, node_pt node);
+static alloc_status _mem_drain_quick_lists(pool_mgr_pt pool_mgr);
+static alloc_status _mem_free_listed_nodes(pool_mgr_pt pool_mgr, node_pt *nodes, unsigned n);
+static int _mem_compactable(pool_mgr_pt pool_mgr);
+static alloc_status _mem_compact(pool_mgr_pt pool_mgr, size_t budget);
+static node_pt _mem_compact_resume(pool_mgr_pt pool_mgr);
+static alloc_status _mem_compact_slide(pool_mgr_pt pool_mgr, node_pt gap);
+static void _mem_auto_compact(pool_mgr_pt pool_mgr);
+static size_t _mem_largest_gap(pool_mgr_pt pool_mgr);
+static size_t _mem_find_largest_gap(pool_mgr_pt pool_mgr, unsigned *count);
+static void _mem_largest_gap_add(pool_mgr_pt pool_mgr, size_t size);
+static void _mem_largest_gap_remove(pool_mgr_pt pool_mgr, size_t size);
+static float _mem_fragmentation(size_t free_size, size_t largest_gap);
+static void _mem_stats(pool_mgr_pt pool_mgr, pool_stats_pt stats);
+static unsigned _mem_cached_blocks(pool_mgr_pt pool_mgr);
+static void _mem_stats_peak(pool_mgr_pt pool_mgr);
+static alloc_status _mem_set_pinned(pool_mgr_pt pool_mgr, void *alloc, unsigned pinned);
+static unsigned _mem_thread_ix();
+#ifdef MEM_POOL_THREAD_SAFE
+static void _mem_thread_ix_init();
+static void _mem_thread_ix_release(void *ix);
+#endif
+static thread_cache_pt _mem_thread_cache(pool_mgr_pt pool_mgr);
+static void * _mem_cache_new_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_cache_del_alloc(pool_mgr_pt pool_mgr, void *alloc);
+static void _mem_flush_thread_caches(pool_mgr_pt pool_mgr);
+static void _mem_free_thread_caches(pool_mgr_pt pool_mgr);
+static void _mem_count(atomic_size_t *counter);
+static void _mem_count_add(atomic_size_t *counter, size_t delta);
+static void _mem_count_reset(thread_cache_pt cache);
+static void * _mem_shard_new_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static void * _mem_shard_steal(pool_mgr_pt pool_mgr, unsigned shard, size_t size, size_t alignment);
+static alloc_status _mem_shard_lend(pool_mgr_pt pool_mgr, alloc_pt loan, unsigned lender, unsigned borrower);
+static alloc_status _mem_shard_del_alloc(pool_mgr_pt pool_mgr, void *alloc);
+static void _mem_shard_settle(pool_mgr_pt pool_mgr, const char *mem);
+static void _mem_shard_settle_all(pool_mgr_pt pool_mgr);
+static alloc_status _mem_shard_return(pool_mgr_pt pool_mgr, unsigned l, unsigned seq, shard_loan_pt loan);
+static void _mem_shard_report(pool_mgr_pt shard);
+static pool_mgr_pt _mem_shard_of(pool_mgr_pt pool_mgr, void *alloc);
+static unsigned _mem_shard_slice(pool_mgr_pt pool_mgr, const char *mem);
+static unsigned _mem_shard_loan_read(pool_mgr_pt pool_mgr, unsigned l, shard_loan_pt loan);
+static unsigned
+        _mem_shard_loan_of(pool_mgr_pt pool_mgr,
+                           unsigned slice,
+                           const char *mem,
+                           shard_loan_pt loan,
+                           unsigned *seq);
+static int _mem_shard_lent(pool_mgr_pt pool_mgr, unsigned shard, void *alloc);
+static void * _mem_shard_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size);
+static alloc_status _mem_shard_close(pool_mgr_pt pool_mgr);
+static void _mem_shard_reset(pool_mgr_pt pool_mgr);
+static void _mem_shard_inspect(pool_mgr_pt pool_mgr,
+                               pool_segment_pt *segments,
+                               unsigned *num_segments);
+static alloc_status _mem_pool_reset(pool_pt pool);
+static void * _mem_new_alloc(pool_pt pool, size_t size, size_t alignment);
+static unsigned
+        _mem_new_alloc_batch(pool_mgr_pt pool_mgr,
+                             const size_t *sizes,
+                             unsigned n,
+                             void **allocs);
+static alloc_status _mem_del_alloc(pool_pt pool, void *alloc);
+static alloc_status _mem_free_node(pool_mgr_pt pool_mgr, node_pt node);
+static alloc_status _mem_del_alloc_batch(pool_mgr_pt pool_mgr, void **allocs, unsigned n);
+static void * _mem_realloc(pool_pt pool, void *alloc, size_t size);
+static size_t _mem_alloc_size(pool_pt pool, void *alloc);
+static void _mem_inspect_pool(pool_pt pool,
+                              pool_segment_pt *segments,
+                              unsigned *num_segments);
+static alloc_status
+        _mem_snapshot(pool_mgr_pt pool_mgr,
+                      pool_mgr_pt sharded,
+                      unsigned shard,
+                      pool_segment_pt *segments,
+                      unsigned *num_segments);
+static alloc_status
+        _mem_snapshot_copy(pool_mgr_pt pool_mgr,
+                           pool_mgr_pt sharded,
+                           unsigned shard,
+                           pool_segment_pt segments,
+                           unsigned capacity,
+                           unsigned *num_segments);
 static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr);
+static node_pt _mem_claim_node(pool_mgr_pt pool_mgr);
+static alloc_status _mem_chunk_ix_add(pool_mgr_pt pool_mgr, node_pt chunk);
+static void _mem_chunk_ix_insert(chunk_ix_pt chunk_ix, uintptr_t span, node_pt chunk);
+static node_pt _mem_chunk_ix_find(pool_mgr_pt pool_mgr, const void *alloc);
+static void _mem_chunk_ix_free(pool_mgr_pt pool_mgr);
+static unsigned _mem_extent_order_pos(pool_mgr_pt pool_mgr, const char *mem);
+static extent_pt _mem_find_extent(pool_mgr_pt pool_mgr, const char *mem);
+static node_pt _mem_add_extent(pool_mgr_pt pool_mgr, size_t size, char *mem);
+static alloc_status _mem_remove_extent(pool_mgr_pt pool_mgr, extent_pt extent);
+static node_pt *_mem_page_map_new(size_t size);
+static void _mem_page_map_set(pool_mgr_pt pool_mgr, node_pt node);
+static node_pt _mem_page_map_start(extent_pt extent, const char *mem);
+static int _mem_segment_holds(node_pt node, const char *mem);
+static node_pt _mem_page_map_find(extent_pt extent, const char *mem);
+static node_pt _mem_alloc_node(pool_mgr_pt pool_mgr, void *alloc);
+static void _mem_release_node(pool_mgr_pt pool_mgr, node_pt node);
+static void * _mem_buddy_new_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_buddy_del_alloc(pool_mgr_pt pool_mgr, node_pt node);
+static void * _mem_slab_new_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_slab_del_alloc(pool_mgr_pt pool_mgr, void *alloc);
+static int _mem_slab_slot_free(pool_mgr_pt pool_mgr, unsigned slot, int side);
+static void _mem_slab_inspect(pool_mgr_pt pool_mgr,
+                              pool_segment_pt *segments,
+                              unsigned *num_segments);
+static void * _mem_arena_new_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static void _mem_tag_open(pool_mgr_pt pool_mgr);
+static void * _mem_tag_new_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static alloc_status _mem_tag_del_alloc(pool_mgr_pt pool_mgr, void *alloc);
+static void * _mem_tag_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size);
+static char * _mem_tag_block(pool_mgr_pt pool_mgr, void *alloc);
+static size_t _mem_tag_block_size(size_t size);
+static void _mem_tag_inspect(pool_mgr_pt pool_mgr,
+                             pool_segment_pt *segments,
+                             unsigned *num_segments);
+static size_t _mem_tag_size(const char *block);
+static int _mem_tag_allocated(const char *block);
+static void _mem_tag_write(char *block, size_t size, size_t allocated);
+static char ** _mem_tag_links(char *block);
+static void _mem_tag_push(pool_mgr_pt pool_mgr, char *block);
+static void _mem_tag_unlink(pool_mgr_pt pool_mgr, char *block);
+static void _mem_arena_inspect(pool_mgr_pt pool_mgr,
+                               pool_segment_pt *segments,
+                               unsigned *num_segments);
 static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr);
 static alloc_status
         _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
@@ -92,6 +430,59 @@ static alloc_status
                                 node_pt node);
 static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr);
 static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr);
+static unsigned _mem_find_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_find_policy_gap_ix(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static unsigned _mem_find_first_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_find_aligned_gap_ix(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static unsigned
+        _mem_find_first_aligned_gap_ix(pool_mgr_pt pool_mgr,
+                                       unsigned gap,
+                                       size_t size,
+                                       size_t alignment);
+static size_t _mem_align_padding(const char *mem, size_t alignment);
+static unsigned _mem_align_shift(size_t alignment);
+static int _mem_gap_fits(pool_mgr_pt pool_mgr, unsigned gap, size_t size, size_t alignment);
+static unsigned _mem_find_class_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_find_tlsf_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static int _mem_gap_ix_has_tree(pool_mgr_pt pool_mgr, gap_tree tree);
+static int _mem_gap_ix_has_lists(pool_mgr_pt pool_mgr);
+static unsigned _mem_size_class(size_t size);
+static unsigned _mem_gap_class(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_lowest_bit(uint64_t bits);
+static unsigned _mem_highest_bit(uint64_t bits);
+static void _mem_gap_class_push(pool_mgr_pt pool_mgr, unsigned gap);
+static void _mem_gap_class_unlink(pool_mgr_pt pool_mgr, unsigned gap);
+static int
+        _mem_gap_ix_cmp(pool_mgr_pt pool_mgr,
+                        gap_tree tree,
+                        unsigned gap,
+                        size_t size,
+                        const char *mem);
+static unsigned _mem_gap_ix_height(pool_mgr_pt pool_mgr, gap_tree tree, unsigned gap);
+static void _mem_gap_ix_update(pool_mgr_pt pool_mgr, gap_tree tree, unsigned gap);
+static unsigned
+        _mem_gap_ix_rotate(pool_mgr_pt pool_mgr,
+                           gap_tree tree,
+                           unsigned gap,
+                           int left);
+static unsigned _mem_gap_ix_balance(pool_mgr_pt pool_mgr, gap_tree tree, unsigned gap);
+static unsigned
+        _mem_gap_ix_insert(pool_mgr_pt pool_mgr,
+                           gap_tree tree,
+                           unsigned root,
+                           unsigned gap);
+static unsigned
+        _mem_gap_ix_unlink_min(pool_mgr_pt pool_mgr,
+                               gap_tree tree,
+                               unsigned root,
+                               unsigned *min);
+static unsigned
+        _mem_gap_ix_unlink(pool_mgr_pt pool_mgr,
+                           gap_tree tree,
+                           unsigned root,
+                           size_t size,
+                           const char *mem,
+                           unsigned *gap);
 
 
 
@@ -102,16 +493,20 @@ static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr);
 /****************************************/
 alloc_status mem_init() {
     // ensure that it's called only once until mem_free
-    // allocate the pool store with initial capacity
+    // open the pool store, its chunks are allocated as slots are taken
     // note: holds pointers only, other functions to allocate/deallocate
-    if(pool_store != NULL){
+    _mem_store_lock();
+    if(atomic_load(&pool_store_open)){
+        _mem_store_unlock();
         return ALLOC_CALLED_AGAIN;
     }
     else {
-        pool_store = calloc(MEM_POOL_STORE_INIT_CAPACITY, sizeof(pool_mgr_pt));
         //update tracking items ie static variables!
-        pool_store_size = 0;
-        pool_store_capacity = MEM_POOL_STORE_INIT_CAPACITY;
+        atomic_store(&pool_store_size, 0);
+        atomic_store(&pool_store_count, 0);
+        atomic_store(&pool_store_free, 0);
+        atomic_store(&pool_store_open, 1);
+        _mem_store_unlock();
         return ALLOC_OK;
     }
 }
@@ -121,32 +516,52 @@ alloc_status mem_free() {
     // make sure all pool managers have been deallocated
     // can free the pool store array
     // update static variables
-    if(pool_store == NULL){
+    // note: the count of open pools saves looking at every slot
+    _mem_store_lock();
+    if(! atomic_load(&pool_store_open)){
+        _mem_store_unlock();
         return ALLOC_CALLED_AGAIN;
     }
     else{
-        for (int i = 0; i < pool_store_size; ++i) {
-            if (pool_store[i] != NULL){
-                return ALLOC_NOT_FREED;
-            }
+        if (atomic_load(&pool_store_count) != 0){
+            _mem_store_unlock();
+            return ALLOC_NOT_FREED;
         }
-        free(pool_store);
-        pool_store = NULL;
-        pool_store_size = 0;
-        pool_store_capacity = 0;
+        atomic_store(&pool_store_open, 0);
+        for (unsigned c = 0; c < MEM_POOL_STORE_MAX_CHUNKS; ++c) {
+            free(atomic_exchange(&pool_store[c], NULL));
+        }
+        atomic_store(&pool_store_size, 0);
+        atomic_store(&pool_store_free, 0);
+        _mem_store_unlock();
         return ALLOC_OK;
     }
 }
 
 pool_pt mem_pool_open(size_t size, alloc_policy policy) {
-    // make sure there the pool store is allocated
-    if(pool_store == NULL){
+    // make sure there the pool store is open
+    if(! atomic_load(&pool_store_open)){
+        return NULL;
+    }
+
+    // slab pools are opened with mem_slab_open
+    if (policy == SLAB) {
         return NULL;
     }
 
-    // TODO: (bonus) expand the pool store, if necessary
-    if(_mem_resize_pool_store() != ALLOC_OK){
-        return  NULL;
+    // boundary-tag pools need room for at least one tagged block, and
+    // their blocks are whole tags, so the pool is too
+    if (policy == BOUNDARY_TAG) {
+        size = size - size % MEM_TAG_SIZE;
+        if (size < MEM_TAG_MIN_BLOCK) {
+            return NULL;
+        }
+    }
+
+    // buddy pools split and merge by halves, so need a power-of-two size
+    if (policy == BUDDY &&
+        (size < MEM_BUDDY_MIN_BLOCK || (size & (size - 1)) != 0)) {
+        return NULL;
     }
 
     // allocate a new mem pool mgr
@@ -158,7 +573,12 @@ pool_pt mem_pool_open(size_t size, alloc_policy policy) {
 
     // allocate a new memory pool
     // check success, on error deallocate mgr and return null
-    char* poolMem = malloc(size);
+    // note: buddy blocks are aligned to their size within the pool, so
+    // the pool is aligned as well, up to a page
+    char* poolMem = (policy == BUDDY) ?
+                    aligned_alloc((size < ((size_t) 1 << MEM_PAGE_MAP_SHIFT)) ?
+                                  size : ((size_t) 1 << MEM_PAGE_MAP_SHIFT), size) :
+                    malloc(size);
     if (poolMem== NULL) {
         free(poolMgr);
         return NULL;
@@ -166,17 +586,51 @@ pool_pt mem_pool_open(size_t size, alloc_policy policy) {
 
     // allocate a new node heap
     // check success, on error deallocate mgr/pool and return null
-    node_pt nodeHeap = calloc(MEM_NODE_HEAP_INIT_CAPACITY, sizeof(node_t));
+    node_pt nodeHeap = calloc(MEM_NODE_HEAP_CHUNK_CAPACITY, sizeof(node_t));
     if (nodeHeap == NULL) {
         free(poolMem);
         free(poolMgr);
         return NULL;
     }
 
+    node_pt *nodeBlocks = malloc(sizeof(node_pt));
+    if (nodeBlocks == NULL) {
+        free(nodeHeap);
+        free(poolMem);
+        free(poolMgr);
+        return NULL;
+    }
+
+    // allocate the extent table and a new page map, for the pools that
+    // have nodes
+    // check success, on error deallocate mgr/pool/heap and return null
+    extent_pt extents = NULL;
+    unsigned *extentOrder = NULL;
+    node_pt *pageMap = NULL;
+    if (policy != ARENA && policy != BOUNDARY_TAG) {
+        extents = malloc(sizeof(extent_t));
+        extentOrder = malloc(sizeof(unsigned));
+        pageMap = _mem_page_map_new(size);
+        if (extents == NULL || extentOrder == NULL || pageMap == NULL) {
+            free(pageMap);
+            free(extentOrder);
+            free(extents);
+            free(nodeBlocks);
+            free(nodeHeap);
+            free(poolMem);
+            free(poolMgr);
+            return NULL;
+        }
+    }
+
     // allocate a new gap index
     // check success, on error deallocate mgr/pool/heap and return null
     gap_pt gapIx = calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(gap_t));
     if(gapIx == NULL) {
+        free(pageMap);
+        free(extentOrder);
+        free(extents);
+        free(nodeBlocks);
         free(nodeHeap);
         free(poolMem);
         free(poolMgr);
@@ -192,282 +646,1718 @@ pool_pt mem_pool_open(size_t size, alloc_policy policy) {
     poolMgr->pool.total_size = size;
 
     poolMgr->node_heap = nodeHeap;
-    poolMgr->total_nodes = MEM_NODE_HEAP_INIT_CAPACITY;
+    poolMgr->total_nodes = MEM_NODE_HEAP_CHUNK_CAPACITY;
     poolMgr->used_nodes = 1;
+    poolMgr->node_blocks = nodeBlocks;
+    poolMgr->node_blocks[0] = nodeHeap;
+    poolMgr->num_node_blocks = 1;
+    poolMgr->node_blocks_capacity = 1;
+
+    // all but the top node are handed out by bumping, the first time
+    poolMgr->node_bump = 1;
+    poolMgr->free_nodes = NULL;
+    atomic_init(&poolMgr->chunk_ix, NULL);
+
+    // the pool memory is the first extent
+    poolMgr->extents = extents;
+    poolMgr->extent_order = extentOrder;
+    poolMgr->num_extents = 0;
+    poolMgr->extents_capacity = 0;
+    poolMgr->growable = 0;
+    if (extents != NULL) {
+        extents[0].mem = poolMem;
+        extents[0].size = size;
+        extents[0].page_map = pageMap;
+        extents[0].granule_map = pageMap + (((size - 1) >> MEM_PAGE_MAP_SHIFT) + 1);
+        extents[0].first = &nodeHeap[0];
+        extents[0].borrowed = 0;
+        extents[0].outer = MEM_EXTENT_NIL;
+        extentOrder[0] = 0;
+        poolMgr->num_extents = 1;
+        poolMgr->extents_capacity = 1;
+    }
 
     poolMgr->gap_ix = gapIx;
     poolMgr->gap_ix_capacity = MEM_GAP_IX_INIT_CAPACITY;
+    poolMgr->gap_ix_root[GAP_TREE_SIZE] = MEM_GAP_IX_NIL;
+    poolMgr->gap_ix_root[GAP_TREE_ADDR] = MEM_GAP_IX_NIL;
+    for (unsigned c = 0; c < MEM_GAP_CLASS_COUNT * MEM_GAP_SUBCLASS_COUNT; ++c) {
+        poolMgr->gap_class_head[c] = MEM_GAP_IX_NIL;
+    }
+    for (unsigned c = 0; c < MEM_GAP_CLASS_COUNT; ++c) {
+        poolMgr->gap_subclass_map[c] = 0;
+    }
+    poolMgr->gap_class_map = 0;
+    poolMgr->largest_gap = 0;
+    poolMgr->largest_gap_exact = 1;
+    poolMgr->largest_gap_count = 0;
 
+    poolMgr->slab_slot_size = 0;
+    poolMgr->slab_count = 0;
+    poolMgr->slab_map = NULL;
+    poolMgr->slab_free = MEM_GAP_IX_NIL;
+    poolMgr->slab_bump = 0;
+    poolMgr->arena_top = 0;
+    for (unsigned c = 0; c < MEM_GAP_CLASS_COUNT; ++c) {
+        poolMgr->tag_class_head[c] = NULL;
+    }
+    poolMgr->cache_capacity = 0;
+    poolMgr->thread_caches = NULL;
+    poolMgr->cache_hits = 0;
+    poolMgr->cache_misses = 0;
+    poolMgr->shards = NULL;
+    poolMgr->num_shards = 0;
+    poolMgr->shard_size = 0;
+    poolMgr->loans = NULL;
+    atomic_init(&poolMgr->num_loans, 0);
+    poolMgr->shard_order = NULL;
+    poolMgr->slice_loans = NULL;
+    poolMgr->parent = NULL;
+    poolMgr->reported_alloc_size = 0;
+    poolMgr->reported_num_allocs = 0;
+    poolMgr->reported_num_gaps = 0;
+    poolMgr->store_slot = MEM_POOL_STORE_NIL;
+    poolMgr->defer_frees = 0;
+    poolMgr->deferred_frees = NULL;
+    poolMgr->num_deferred = 0;
+    poolMgr->deferred_capacity = 0;
+    poolMgr->quick_capacity = 0;
+    poolMgr->quick_nodes = NULL;
+    for (unsigned l = 0; l < MEM_QUICK_LIST_COUNT; ++l) {
+        poolMgr->quick_size[l] = 0;
+        poolMgr->quick_count[l] = 0;
+    }
+    poolMgr->num_quick = 0;
+    poolMgr->compact_cursor = NULL;
+    poolMgr->compact_threshold = 0;
+    poolMgr->compact_budget = 0;
+    for (unsigned c = 0; c < MEM_STATS_GAP_CLASSES; ++c) {
+        poolMgr->gap_histogram[c] = 0;
+    }
+    poolMgr->peak_alloc_size = 0;
+    poolMgr->peak_used_nodes = 1;
+    poolMgr->total_allocs = 0;
+    poolMgr->total_frees = 0;
+    poolMgr->total_failures = 0;
+    poolMgr->remote_failures = 0;
 
     //   initialize top node of node heap
     nodeHeap[0].used = 1;
     nodeHeap[0].allocated = 0;
+    nodeHeap[0].extent_start = 1;
     nodeHeap[0].alloc_record.mem = poolMem;
     nodeHeap[0].alloc_record.size = size;
     nodeHeap[0].next = NULL;
     nodeHeap[0].prev = NULL;
 
     //   initialize top node of gap index
-    _mem_add_to_gap_ix(poolMgr, size, &nodeHeap[0]);
+    //   note: boundary-tag pools keep their gaps in the pool memory instead
+    if (policy == BOUNDARY_TAG) {
+        _mem_tag_open(poolMgr);
+    } else {
+        _mem_add_to_gap_ix(poolMgr, size, &nodeHeap[0]);
+    }
+
+    //   initialize pool mgr lock and remote-free queue
+    //   check success, on error deallocate everything and return null
+    if (_mem_pool_sync_init(poolMgr) != ALLOC_OK) {
+        free(gapIx);
+        free(pageMap);
+        free(extentOrder);
+        free(extents);
+        free(nodeBlocks);
+        free(nodeHeap);
+        free(poolMem);
+        free(poolMgr);
+        return NULL;
+    }
+
+    //   index the first node chunk
+    //   check success, on error free the pool and return null
+    if (_mem_chunk_ix_add(poolMgr, nodeHeap) != ALLOC_OK) {
+        _mem_pool_free(poolMgr);
+        return NULL;
+    }
 
-    //   initialize pool mgr
     //   link pool mgr to pool store
-    pool_store[pool_store_size] = poolMgr;
-    pool_store_size++;
+    //   check success, on error free the pool and return null
+    if (_mem_link_pool_store(poolMgr) != ALLOC_OK) {
+        _mem_pool_free(poolMgr);
+        return NULL;
+    }
 
     // return the address of the mgr, cast to (pool_pt)
     return (pool_pt) poolMgr;
 }
 
-alloc_status mem_pool_close(pool_pt pool) {
-    // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+pool_pt mem_slab_open(size_t object_size, unsigned count) {
+    // make sure there the pool store is open
+    if(! atomic_load(&pool_store_open)){
+        return NULL;
+    }
 
-    // check if this pool is allocated
-    if (poolMgr == NULL) {
-        return ALLOC_NOT_FREED;
+    // a free slot holds the position of the next free slot
+    size_t slotSize = (object_size < sizeof(unsigned)) ? sizeof(unsigned) : object_size;
+    if (object_size == 0 || count == 0 || count == MEM_GAP_IX_NIL ||
+        slotSize > (size_t) -1 / count) {
+        return NULL;
     }
 
-    // check if pool has only one gap
-    if (poolMgr->pool.num_gaps > 1) {
-        return ALLOC_NOT_FREED;
+    // allocate a new mem pool mgr
+    // check success, on error return null
+    pool_mgr_pt poolMgr = calloc(1, sizeof(pool_mgr_t));
+    if(poolMgr == NULL) {
+        return NULL;
     }
 
-    // check if it has zero allocations
-    if (poolMgr->pool.num_allocs != 0) {
-        return ALLOC_NOT_FREED;
+    // allocate a new memory pool
+    // check success, on error deallocate mgr and return null
+    char* poolMem = malloc(slotSize * count);
+    if (poolMem == NULL) {
+        free(poolMgr);
+        return NULL;
     }
 
-    // free memory pool
-    free(poolMgr->pool.mem);
+    // allocate the occupancy bitmap, one bit per slot
+    // check success, on error deallocate mgr/pool and return null
+    uint64_t *slabMap = calloc((count + 63) / 64, sizeof(uint64_t));
+    if (slabMap == NULL) {
+        free(poolMem);
+        free(poolMgr);
+        return NULL;
+    }
 
-    // free node heap
-    free(poolMgr->node_heap);
+    // assign all the pointers and update meta data:
+    // note: there is no node heap or gap index, the pool starts as one gap
+    poolMgr->pool.mem = poolMem;
+    poolMgr->pool.alloc_size = 0;
+    poolMgr->pool.num_allocs = 0;
+    poolMgr->pool.num_gaps = 1;
+    poolMgr->pool.policy = SLAB;
+    poolMgr->pool.total_size = slotSize * count;
 
-    // free gap index
-    free(poolMgr->gap_ix);
+    poolMgr->gap_ix_root[GAP_TREE_SIZE] = MEM_GAP_IX_NIL;
+    poolMgr->gap_ix_root[GAP_TREE_ADDR] = MEM_GAP_IX_NIL;
 
-    // find mgr in pool store and set to null
-    for (int i = 0; i < pool_store_size; i++) {
-        if(pool_store[i] == poolMgr) {
-            pool_store[i] = NULL;
-            break;
-        }
+    poolMgr->slab_slot_size = slotSize;
+    poolMgr->slab_count = count;
+    poolMgr->slab_map = slabMap;
+    poolMgr->slab_free = MEM_GAP_IX_NIL;
+    poolMgr->slab_bump = 0;
+    poolMgr->store_slot = MEM_POOL_STORE_NIL;
+
+    //   initialize pool mgr lock and remote-free queue
+    //   check success, on error deallocate mgr/pool/bitmap and return null
+    if (_mem_pool_sync_init(poolMgr) != ALLOC_OK) {
+        free(slabMap);
+        free(poolMem);
+        free(poolMgr);
+        return NULL;
     }
 
-    // note: don't decrement pool_store_size, because it only grows
-    // free mgr
-    free(poolMgr);
+    //   link pool mgr to pool store
+    //   check success, on error free the pool and return null
+    if (_mem_link_pool_store(poolMgr) != ALLOC_OK) {
+        _mem_pool_free(poolMgr);
+        return NULL;
+    }
 
-    return ALLOC_OK;
+    // return the address of the mgr, cast to (pool_pt)
+    return (pool_pt) poolMgr;
 }
 
-void * mem_new_alloc(pool_pt pool, size_t size) {
-    // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+pool_pt mem_pool_open_growable(size_t size, alloc_policy policy) {
+    // only the policies that split and merge gaps freely can take in
+    // memory that is not next to the pool
+    if (policy != FIRST_FIT && policy != BEST_FIT &&
+        policy != SEGREGATED_FIT && policy != TLSF) {
+        return NULL;
+    }
 
-    // check if any gaps, return null if none
-    if (poolMgr->gap_ix_capacity == 0){
+    // open as usual, the pool grows by extents once no gap fits
+    pool_mgr_pt poolMgr = (pool_mgr_pt) mem_pool_open(size, policy);
+    if (poolMgr == NULL) {
         return NULL;
     }
+    poolMgr->growable = 1;
 
-    // expand heap node, if necessary, quit on error
-    if (_mem_resize_node_heap(poolMgr) !=ALLOC_OK){
+    return (pool_pt) poolMgr;
+}
+
+pool_pt mem_pool_open_sharded(size_t size, alloc_policy policy, unsigned num_shards) {
+    // make sure there the pool store is open
+    if(! atomic_load(&pool_store_open)){
         return NULL;
     }
 
-    // check used nodes fewer than total nodes, quit on error
-    if (poolMgr->total_nodes <= poolMgr->used_nodes){
+    // only the policies that can take in memory that is not next to the
+    // pool can borrow from the other shards, and each shard needs memory
+    if ((policy != FIRST_FIT && policy != BEST_FIT &&
+         policy != SEGREGATED_FIT && policy != TLSF) ||
+        num_shards == 0 || size / num_shards == 0) {
         return NULL;
     }
-    // get a node for allocation:
-    node_pt nodeForAlloc = NULL;
 
-    // if FIRST_FIT, then find the first sufficient node in the node heap
-    if (poolMgr->pool.policy==FIRST_FIT){
-        nodeForAlloc = poolMgr->node_heap;
-        while (nodeForAlloc->allocated == 1 || nodeForAlloc->alloc_record.size < size){
-            if(nodeForAlloc->next == NULL){
-                return NULL;
-            }
-            nodeForAlloc = nodeForAlloc->next;
-        }
+    // allocate a new mem pool mgr, and the tables of shards and loans
+    // check success, on error deallocate them and return null
+    pool_mgr_pt poolMgr = calloc(1, sizeof(pool_mgr_t));
+    pool_mgr_pt *shards = calloc(num_shards, sizeof(pool_mgr_pt));
+    shard_loan_pt loans = malloc(sizeof(shard_loan_t) * MEM_SHARD_MAX_LOANS);
+    unsigned *shardOrder = calloc(num_shards, sizeof(unsigned));
+    atomic_uint *sliceLoans = calloc(num_shards, sizeof(atomic_uint));
+    if (poolMgr == NULL || shards == NULL || loans == NULL ||
+        shardOrder == NULL || sliceLoans == NULL) {
+        free(sliceLoans);
+        free(shardOrder);
+        free(loans);
+        free(shards);
+        free(poolMgr);
+        return NULL;
+    }
+    for (unsigned l = 0; l < MEM_SHARD_MAX_LOANS; ++l) {
+        atomic_init(&loans[l].seq, 0);
+    }
+    for (unsigned s = 0; s < num_shards; ++s) {
+        atomic_init(&sliceLoans[s], 0);
     }
 
-    // if BEST_FIT, then find the first sufficient node in the gap index
-    else {
-        int check = 1;
-        int nodeIndex = 0;
-        while (check && nodeIndex < poolMgr->pool.num_gaps){
-            if (poolMgr->gap_ix[nodeIndex].size >= size){
-                check = 0;
-                nodeForAlloc = poolMgr->gap_ix[nodeIndex].node;
+    // open the shards, with an equal part of the size each
+    // check success, on error close the ones opened and return null
+    size_t shardSize = size / num_shards;
+    for (unsigned s = 0; s < num_shards; ++s) {
+        shards[s] = (pool_mgr_pt) mem_pool_open(shardSize, policy);
+        if (shards[s] == NULL) {
+            for (unsigned t = 0; t < s; ++t) {
+                mem_pool_close((pool_pt) shards[t]);
             }
-            else{
-                nodeIndex =  nodeIndex +1;
-            }
-        }
-
-        // check if node found
-        if(nodeIndex == poolMgr->pool.num_gaps) {
+            free(sliceLoans);
+            free(shardOrder);
+            free(loans);
+            free(shards);
+            free(poolMgr);
             return NULL;
         }
     }
 
-    // update metadata (num_allocs, alloc_size)
-    poolMgr->pool.num_allocs++;
-    poolMgr->pool.alloc_size = poolMgr->pool.alloc_size + size;
+    // sort the shards by the address of their own memory, so that the
+    // shard of an address is a binary search (insertion sort, there are few)
+    for (unsigned s = 0; s < num_shards; ++s) {
+        unsigned t = s;
+        for (; t > 0 && shards[shardOrder[t - 1]]->pool.mem > shards[s]->pool.mem; --t) {
+            shardOrder[t] = shardOrder[t - 1];
+        }
+        shardOrder[t] = s;
+    }
 
-    // calculate the size of the remaining gap, if any
-    size_t remainingSize = nodeForAlloc->alloc_record.size - size;
+    // assign all the pointers and update meta data:
+    // note: there is no memory of its own, the pool shows that of the
+    // first shard
+    poolMgr->pool.mem = shards[0]->pool.mem;
+    poolMgr->pool.alloc_size = 0;
+    poolMgr->pool.num_allocs = 0;
+    poolMgr->pool.num_gaps = num_shards;
+    poolMgr->pool.policy = policy;
+    poolMgr->pool.total_size = shardSize * num_shards;
 
-    // remove node from gap index
-    _mem_remove_from_gap_ix(poolMgr, nodeForAlloc->alloc_record.size, nodeForAlloc);
+    poolMgr->gap_ix_root[GAP_TREE_SIZE] = MEM_GAP_IX_NIL;
+    poolMgr->gap_ix_root[GAP_TREE_ADDR] = MEM_GAP_IX_NIL;
 
-    // convert gap_node to an allocation node of given size
-    nodeForAlloc->alloc_record.size = size;
-    nodeForAlloc->allocated = 1;
+    poolMgr->shards = shards;
+    poolMgr->num_shards = num_shards;
+    poolMgr->shard_size = shardSize;
+    poolMgr->loans = loans;
+    atomic_init(&poolMgr->num_loans, 0);
+    poolMgr->shard_order = shardOrder;
+    poolMgr->slice_loans = sliceLoans;
+    poolMgr->store_slot = MEM_POOL_STORE_NIL;
 
-    // adjust node heap:
-    //   if remaining gap, need a new node
-    //   find an unused one in the node heap
-    if (remainingSize > 0){
-        node_pt newGapNode = NULL;
-        for (int i = 0; i < poolMgr->total_nodes; ++i) {
-            if (poolMgr->node_heap[i].used == 0){
-                newGapNode = &poolMgr->node_heap[i];
-                break;
-            }
+    //   initialize pool mgr lock, which guards the loan slots and the counts
+    //   check success, on error close the shards and return null
+    if (_mem_pool_sync_init(poolMgr) != ALLOC_OK) {
+        for (unsigned s = 0; s < num_shards; ++s) {
+            mem_pool_close((pool_pt) shards[s]);
         }
+        free(sliceLoans);
+        free(shardOrder);
+        free(loans);
+        free(shards);
+        free(poolMgr);
+        return NULL;
+    }
 
-        //   initialize it to a gap node
-        newGapNode->used = 1;
-        newGapNode->alloc_record.size = remainingSize;
-        newGapNode->alloc_record.mem = nodeForAlloc->alloc_record.mem + size;
-        newGapNode->allocated = 0;
-
-        //   update metadata (used_nodes)
-        poolMgr->used_nodes++;
-
-        //   update linked list (new node right after the node for allocation)
-        newGapNode->next = nodeForAlloc->next;
-        newGapNode->prev = nodeForAlloc;
-        if (nodeForAlloc->next != NULL){
-            nodeForAlloc->next->prev = newGapNode;
+    //   link pool mgr to pool store
+    //   check success, on error close the shards and return null
+    if (_mem_link_pool_store(poolMgr) != ALLOC_OK) {
+        for (unsigned s = 0; s < num_shards; ++s) {
+            mem_pool_close((pool_pt) shards[s]);
         }
-        nodeForAlloc->next = newGapNode;
+        free(sliceLoans);
+        free(shardOrder);
+        free(loans);
+        free(shards);
+        _mem_pool_sync_destroy(poolMgr);
+        free(poolMgr);
+        return NULL;
+    }
 
-        //   add to gap index
-        if(_mem_add_to_gap_ix(poolMgr,newGapNode->alloc_record.size, newGapNode) != ALLOC_OK){
-            return NULL;
-        }
+    // each shard hands the changes in its counts to the pool as it unlocks,
+    // starting from what the pool shows now
+    for (unsigned s = 0; s < num_shards; ++s) {
+        shards[s]->parent = poolMgr;
+        shards[s]->reported_alloc_size = shards[s]->pool.alloc_size;
+        shards[s]->reported_num_allocs = shards[s]->pool.num_allocs;
+        shards[s]->reported_num_gaps = shards[s]->pool.num_gaps;
     }
-    //   make sure one was found
-    //for (int i = 0; i < poolMgr->total_nodes; ++i) {
-    //   if(&poolMgr->node_heap[i] == NULL){
-    //
-    //    }
-    //}
 
-    // return allocation record by casting the node to (alloc_pt)
-    return (alloc_pt)nodeForAlloc;
+    // return the address of the mgr, cast to (pool_pt)
+    return (pool_pt) poolMgr;
 }
 
-alloc_status mem_del_alloc(pool_pt pool, void * alloc) {
+alloc_status mem_pool_set_thread_cache(pool_pt pool, unsigned capacity) {
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
     pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
-    // get node from alloc by casting the pointer to (node_pt)
-    node_pt nodePt = (node_pt)alloc;
-    // find the node in the node heap
-    // this is node-to-delete (nodePt)
-    // make sure it's found
-    if(nodePt == NULL){
+
+    // only the pools that hand out nodes can tell the size of a handle
+    // without the lock, and only those that do not grow can tell a
+    // handle from a data pointer
+    if (poolMgr == NULL || poolMgr->growable || poolMgr->num_shards > 0 ||
+        poolMgr->pool.policy == SLAB ||
+        poolMgr->pool.policy == ARENA || poolMgr->pool.policy == BOUNDARY_TAG) {
         return ALLOC_FAIL;
     }
-    // convert to gap node
-    nodePt->allocated = 0;
-    // update metadata (num_allocs, alloc_size)
-    poolMgr->pool.num_allocs--;
-    poolMgr->pool.alloc_size = poolMgr->pool.alloc_size - nodePt->alloc_record.size;
-    // if the next node in the list is also a gap, merge into node-to-delete
-    if (nodePt->next !=NULL && nodePt->next->allocated == 0 && nodePt->next->used){
-        node_pt next = nodePt->next;
-        //   remove the next node from gap index
-        //   check success
-        if(_mem_remove_from_gap_ix(poolMgr,next->alloc_record.size, next) != ALLOC_OK){
-            return ALLOC_FAIL;
-        }
-        //   add the size to the node-to-delete
-        nodePt->alloc_record.size = nodePt->alloc_record.size + next->alloc_record.size;
-        //   update node as unused
-        next->used = 0;
-        //   update metadata (used nodes)
-        poolMgr->used_nodes--;
-        //   update linked list:
 
-        if (next->next) {
-            next->next->prev = nodePt;
-            nodePt->next = next->next;
+    _mem_pool_lock(poolMgr);
+
+    // give the blocks in the thread caches back, and start over
+    alloc_status status = ALLOC_OK;
+    _mem_flush_thread_caches(poolMgr);
+    _mem_free_thread_caches(poolMgr);
+    if (capacity > 0) {
+        poolMgr->thread_caches = calloc(MEM_THREAD_CACHE_MAX_THREADS, sizeof(thread_cache_pt));
+        if (poolMgr->thread_caches != NULL) {
+            poolMgr->cache_capacity = capacity;
         } else {
-            nodePt->next = NULL;
+            status = ALLOC_FAIL;
         }
-        next->next = NULL;
-        next->prev = NULL;
+    }
+
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
 
+alloc_status mem_pool_thread_cache_stats(pool_pt pool, size_t *hits, size_t *misses) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (poolMgr == NULL) {
+        return ALLOC_FAIL;
     }
-    // this merged node-to-delete might need to be added to the gap index
-    // but one more thing to check...
-    // if the previous node in the list is also a gap, merge into previous!
-    if(nodePt->prev != NULL && nodePt->prev->allocated == 0 && nodePt->prev->used){
-        node_pt prev = nodePt->prev;
-        //   remove the previous node from gap index
-        //   check success
-        if(_mem_remove_from_gap_ix(poolMgr,prev->alloc_record.size, prev) != ALLOC_OK){
-            return ALLOC_FAIL;
-        }
-        //   add the size of node-to-delete to the previous
-        prev->alloc_record.size = prev->alloc_record.size + nodePt->alloc_record.size;
-        //   update node-to-delete as unused
-        nodePt->used = 0;
-        //   update metadata (used_nodes)
-        poolMgr->used_nodes--;
-        //   update linked list
-        if (nodePt->next) {
-            prev->next = nodePt->next;
-            nodePt->next->prev = prev;
-        } else {
-            prev->next = NULL;
+
+    _mem_pool_lock_read(poolMgr);
+
+    // the counts of the caches freed so far, and of the current ones
+    *hits = poolMgr->cache_hits;
+    *misses = poolMgr->cache_misses;
+    for (unsigned t = 0; poolMgr->thread_caches != NULL && t < MEM_THREAD_CACHE_MAX_THREADS; ++t) {
+        thread_cache_pt cache = poolMgr->thread_caches[t];
+        if (cache != NULL) {
+            *hits += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+            *misses += atomic_load_explicit(&cache->misses, memory_order_relaxed);
         }
-        nodePt->next = NULL;
-        nodePt->prev = NULL;
-        // change the node to add to the previous node!
-        nodePt = prev;
     }
-    // add the resulting node to the gap index
-    // check success
-    if(_mem_add_to_gap_ix(poolMgr, nodePt->alloc_record.size, nodePt) != ALLOC_OK){
+
+    _mem_pool_unlock(poolMgr);
+
+    return ALLOC_OK;
+}
+
+alloc_status mem_pool_set_owner(pool_pt pool) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (poolMgr == NULL) {
         return ALLOC_FAIL;
     }
+
+    // a sharded pool hands over all its shards
+    for (unsigned s = 0; s < poolMgr->num_shards; ++s) {
+        mem_pool_set_owner((pool_pt) poolMgr->shards[s]);
+    }
+
+#ifdef MEM_POOL_THREAD_SAFE
+    _mem_pool_lock_read(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    poolMgr->owner = pthread_self();
+    _mem_pool_unlock(poolMgr);
+#endif
+
     return ALLOC_OK;
 }
 
-void mem_inspect_pool(pool_pt pool,
-                      pool_segment_pt *segments,
-                      unsigned *num_segments) {
-    // get the mgr from the pool
+alloc_status mem_pool_set_deferred_free(pool_pt pool, unsigned enable) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
     pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
 
-    // allocate the segments array with size == used_nodes
-    // check successful
-    pool_segment_pt segmentArray = calloc(poolMgr->used_nodes, sizeof(pool_segment_t));
-    if (segmentArray == NULL){
-        segments = NULL;
-        return;
+    // only the pools with a node list coalesce their gaps
+    if (poolMgr == NULL || poolMgr->pool.policy == SLAB ||
+        poolMgr->pool.policy == ARENA || poolMgr->pool.policy == BOUNDARY_TAG) {
+        return ALLOC_FAIL;
     }
 
-    // loop through the node heap and the segments array
-    //    for each node, write the size and allocated in the segment
-    node_pt currentNode = poolMgr->node_heap;
+    // a sharded pool sets all its shards
+    alloc_status status = ALLOC_OK;
+    for (unsigned s = 0; s < poolMgr->num_shards; ++s) {
+        if (mem_pool_set_deferred_free((pool_pt) poolMgr->shards[s], enable) != ALLOC_OK) {
+            status = ALLOC_FAIL;
+        }
+    }
+
+    // the frees queued so far are coalesced as the mode is turned off
+    _mem_pool_lock(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    if (! enable && _mem_drain_deferred_frees(poolMgr) != ALLOC_OK) {
+        status = ALLOC_FAIL;
+    }
+    poolMgr->defer_frees = (enable != 0);
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+alloc_status mem_pool_maintain(pool_pt pool) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (poolMgr == NULL) {
+        return ALLOC_FAIL;
+    }
+
+    // a sharded pool maintains all its shards, and then gives back the
+    // loans that coalesced with them
+    alloc_status status = ALLOC_OK;
+    for (unsigned s = 0; s < poolMgr->num_shards; ++s) {
+        if (mem_pool_maintain((pool_pt) poolMgr->shards[s]) != ALLOC_OK) {
+            status = ALLOC_FAIL;
+        }
+    }
+    if (poolMgr->num_shards > 0) {
+        _mem_shard_settle_all(poolMgr);
+    }
+
+    // coalesce the deferred frees and the quick lists, and the remote
+    // frees with them
+    _mem_pool_lock(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    if (_mem_drain_deferred_frees(poolMgr) != ALLOC_OK) {
+        status = ALLOC_FAIL;
+    }
+    if (_mem_drain_quick_lists(poolMgr) != ALLOC_OK) {
+        status = ALLOC_FAIL;
+    }
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+alloc_status mem_pool_set_quick_lists(pool_pt pool, unsigned capacity) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    // only the pools with a gap index coalesce on every free
+    if (poolMgr == NULL ||
+        (poolMgr->pool.policy != FIRST_FIT && poolMgr->pool.policy != BEST_FIT &&
+         poolMgr->pool.policy != SEGREGATED_FIT && poolMgr->pool.policy != TLSF)) {
+        return ALLOC_FAIL;
+    }
+
+    // a sharded pool sets all its shards, and has no nodes of its own
+    if (poolMgr->num_shards > 0) {
+        alloc_status status = ALLOC_OK;
+        for (unsigned s = 0; s < poolMgr->num_shards; ++s) {
+            if (mem_pool_set_quick_lists((pool_pt) poolMgr->shards[s], capacity) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+        }
+        return status;
+    }
+
+    _mem_pool_lock(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+
+    // coalesce the nodes on the lists, and start over
+    alloc_status status = _mem_drain_quick_lists(poolMgr);
+    free(poolMgr->quick_nodes);
+    poolMgr->quick_nodes = NULL;
+    poolMgr->quick_capacity = 0;
+    if (capacity > 0) {
+        poolMgr->quick_nodes = malloc(sizeof(node_pt) * MEM_QUICK_LIST_COUNT * (size_t) capacity);
+        if (poolMgr->quick_nodes != NULL) {
+            poolMgr->quick_capacity = capacity;
+        } else {
+            status = ALLOC_FAIL;
+        }
+    }
+
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+alloc_status mem_pool_set_auto_compact(pool_pt pool, float threshold, size_t budget) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (! _mem_compactable(poolMgr) || ! (threshold >= 0 && threshold < 1)) {
+        return ALLOC_FAIL;
+    }
+
+    _mem_pool_lock_read(poolMgr);
+    poolMgr->compact_threshold = threshold;
+    poolMgr->compact_budget = budget;
+    _mem_pool_unlock(poolMgr);
+
+    return ALLOC_OK;
+}
+
+alloc_status mem_pool_compact(pool_pt pool, size_t budget) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (! _mem_compactable(poolMgr)) {
+        return ALLOC_FAIL;
+    }
+
+    // coalesce the freed blocks first, so they are not moved
+    _mem_pool_lock(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    alloc_status status = ALLOC_FAIL;
+    if (_mem_drain_deferred_frees(poolMgr) == ALLOC_OK &&
+        _mem_drain_quick_lists(poolMgr) == ALLOC_OK) {
+        status = _mem_compact(poolMgr, budget);
+    }
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+alloc_status mem_pool_stats(pool_pt pool, pool_stats_pt stats) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (poolMgr == NULL || stats == NULL) {
+        return ALLOC_FAIL;
+    }
+
+    if (poolMgr->num_shards == 0) {
+        _mem_pool_lock_read(poolMgr);
+        _mem_drain_remote_frees(poolMgr);
+        _mem_stats(poolMgr, stats);
+        _mem_pool_unlock(poolMgr);
+        return ALLOC_OK;
+    }
+
+    // sharded pools add up the stats of the shards, each under its lock
+    // note: the peaks add up to an upper bound, as the shards may peak
+    // at different times
+    memset(stats, 0, sizeof(pool_stats_t));
+    size_t freeSize = 0;
+    for (unsigned s = 0; s < poolMgr->num_shards; ++s) {
+        pool_mgr_pt shard = poolMgr->shards[s];
+        pool_stats_t shardStats;
+        _mem_pool_lock_read(shard);
+        _mem_drain_remote_frees(shard);
+        _mem_stats(shard, &shardStats);
+        freeSize += shard->pool.total_size - shard->pool.alloc_size;
+        _mem_pool_unlock(shard);
+
+        if (shardStats.largest_gap > stats->largest_gap) {
+            stats->largest_gap = shardStats.largest_gap;
+        }
+        for (unsigned c = 0; c < MEM_STATS_GAP_CLASSES; ++c) {
+            stats->gap_histogram[c] += shardStats.gap_histogram[c];
+        }
+        stats->peak_alloc_size += shardStats.peak_alloc_size;
+        stats->peak_used_nodes += shardStats.peak_used_nodes;
+        stats->total_allocs += shardStats.total_allocs;
+        stats->total_frees += shardStats.total_frees;
+        stats->remote_failures += shardStats.remote_failures;
+        stats->cached_blocks += shardStats.cached_blocks;
+        stats->cached_size += shardStats.cached_size;
+    }
+    stats->fragmentation = _mem_fragmentation(freeSize, stats->largest_gap);
+
+    // a shard that fails may still borrow, so the pool counts its failures
+    _mem_pool_lock_read(poolMgr);
+    stats->total_failures = poolMgr->total_failures;
+    _mem_pool_unlock(poolMgr);
+
+    return ALLOC_OK;
+}
+
+alloc_status mem_pool_close(pool_pt pool) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    // check if this pool is allocated
+    if (poolMgr == NULL) {
+        return ALLOC_NOT_FREED;
+    }
+
+    // sharded pools close their shards
+    if (poolMgr->num_shards > 0) {
+        return _mem_shard_close(poolMgr);
+    }
+
+    // give the blocks in the thread caches and the remote-free queue back
+    // to the pool, and coalesce the deferred frees and the quick lists
+    _mem_flush_thread_caches(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    _mem_drain_deferred_frees(poolMgr);
+    _mem_drain_quick_lists(poolMgr);
+
+    // check if pool has only one gap (per extent, as they never merge)
+    if (poolMgr->pool.num_gaps > 1 && poolMgr->pool.num_gaps > poolMgr->num_extents) {
+        return ALLOC_NOT_FREED;
+    }
+
+    // check if it has zero allocations
+    if (poolMgr->pool.num_allocs != 0) {
+        return ALLOC_NOT_FREED;
+    }
+
+    // free the memory, the metadata, and the mgr
+    _mem_pool_free(poolMgr);
+
+    return ALLOC_OK;
+}
+
+alloc_status mem_pool_reset(pool_pt pool) {
+    // check if this pool is allocated
+    if (pool == NULL) {
+        return ALLOC_FAIL;
+    }
+
+    // sharded pools reset every shard, and forget the loans
+    // note: the shards are locked first, as they take the lock of the pool
+    // to hand on their counts
+    if (((pool_mgr_pt) pool)->num_shards > 0) {
+        _mem_shard_reset((pool_mgr_pt) pool);
+        return ALLOC_OK;
+    }
+
+    _mem_pool_lock((pool_mgr_pt) pool);
+    _mem_drain_remote_frees((pool_mgr_pt) pool);
+    alloc_status status = _mem_pool_reset(pool);
+    _mem_pool_unlock((pool_mgr_pt) pool);
+
+    return status;
+}
+
+void * mem_new_alloc(pool_pt pool, size_t size) {
+    // any address is aligned to 1
+    return mem_new_alloc_aligned(pool, size, 1);
+}
+
+void * mem_new_alloc_aligned(pool_pt pool, size_t size, size_t alignment) {
+    // sharded pools allocate from the shard of the calling thread
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (poolMgr->num_shards > 0) {
+        return _mem_shard_new_alloc(poolMgr, size, alignment);
+    }
+
+    // small allocations come out of the thread cache, if the pool has them
+    if (poolMgr->cache_capacity > 0 && alignment == 1 && size > 0 &&
+        size <= MEM_THREAD_CACHE_CLASS_SIZE * MEM_THREAD_CACHE_CLASS_COUNT) {
+        return _mem_cache_new_alloc(poolMgr, size);
+    }
+
+    _mem_pool_lock((pool_mgr_pt) pool);
+    _mem_drain_remote_frees((pool_mgr_pt) pool);
+    void *alloc = _mem_new_alloc(pool, size, alignment);
+    if (alloc == NULL) {
+        poolMgr->total_failures++;
+    }
+    _mem_pool_unlock((pool_mgr_pt) pool);
+
+    return alloc;
+}
+
+unsigned mem_new_alloc_batch(pool_pt pool, const size_t *sizes, unsigned n, void **allocs) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    unsigned numAllocs = 0;
+
+    if (poolMgr->num_shards > 0) {
+        // sharded pools allocate from the shard of the calling thread, one
+        // at a time, as a shard may borrow for any of them
+        while (numAllocs < n &&
+               (allocs[numAllocs] = _mem_shard_new_alloc(poolMgr, sizes[numAllocs], 1)) != NULL) {
+            numAllocs++;
+        }
+    } else {
+        _mem_pool_lock(poolMgr);
+        _mem_drain_remote_frees(poolMgr);
+        numAllocs = _mem_new_alloc_batch(poolMgr, sizes, n, allocs);
+        if (numAllocs < n) {
+            poolMgr->total_failures++;
+        }
+        _mem_pool_unlock(poolMgr);
+    }
+
+    // the allocations from the first one that failed on are null
+    for (unsigned i = numAllocs; i < n; ++i) {
+        allocs[i] = NULL;
+    }
+
+    return numAllocs;
+}
+
+alloc_status mem_del_alloc(pool_pt pool, void * alloc) {
+    // sharded pools deallocate in the shard that owns the memory
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (poolMgr->num_shards > 0) {
+        return _mem_shard_del_alloc(poolMgr, alloc);
+    }
+
+    // small allocations go into the thread cache, if the pool has them
+    if (poolMgr->cache_capacity > 0 && _mem_cache_del_alloc(poolMgr, alloc) == ALLOC_OK) {
+        return ALLOC_OK;
+    }
+
+    // deallocations by other threads than the owner are queued, unless
+    // the queue is full
+    if (_mem_remote_free(poolMgr, alloc) == ALLOC_OK) {
+        return ALLOC_OK;
+    }
+
+    _mem_pool_lock((pool_mgr_pt) pool);
+    _mem_drain_remote_frees(poolMgr);
+    alloc_status status = _mem_del_alloc(pool, alloc);
+    _mem_auto_compact(poolMgr);
+    _mem_pool_unlock((pool_mgr_pt) pool);
+
+    return status;
+}
+
+alloc_status mem_del_alloc_batch(pool_pt pool, void **allocs, unsigned n) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
+
+    // sharded pools deallocate each in the shard that owns the memory
+    if (poolMgr->num_shards > 0) {
+        for (unsigned i = 0; i < n; ++i) {
+            if (mem_del_alloc(pool, allocs[i]) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+        }
+        return status;
+    }
+
+    _mem_pool_lock(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    status = _mem_del_alloc_batch(poolMgr, allocs, n);
+    _mem_auto_compact(poolMgr);
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+void * mem_realloc(pool_pt pool, void * alloc, size_t size) {
+    if (((pool_mgr_pt) pool)->num_shards > 0) {
+        return _mem_shard_realloc((pool_mgr_pt) pool, alloc, size);
+    }
+
+    _mem_pool_lock((pool_mgr_pt) pool);
+    _mem_drain_remote_frees((pool_mgr_pt) pool);
+    void *newAlloc = _mem_realloc(pool, alloc, size);
+    _mem_pool_unlock((pool_mgr_pt) pool);
+
+    return newAlloc;
+}
+
+size_t mem_alloc_size(pool_pt pool, void * alloc) {
+    if (((pool_mgr_pt) pool)->num_shards > 0) {
+        pool_mgr_pt shard = _mem_shard_of((pool_mgr_pt) pool, alloc);
+        return (shard != NULL) ? mem_alloc_size((pool_pt) shard, alloc) : 0;
+    }
+
+    _mem_pool_lock_read((pool_mgr_pt) pool);
+    _mem_drain_remote_frees((pool_mgr_pt) pool);
+    size_t size = _mem_alloc_size(pool, alloc);
+    _mem_pool_unlock((pool_mgr_pt) pool);
+
+    return size;
+}
+
+alloc_status mem_pin_alloc(pool_pt pool, void * alloc) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (! _mem_compactable(poolMgr)) {
+        return ALLOC_FAIL;
+    }
+
+    _mem_pool_lock_read(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    alloc_status status = _mem_set_pinned(poolMgr, alloc, 1);
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+alloc_status mem_unpin_alloc(pool_pt pool, void * alloc) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    if (! _mem_compactable(poolMgr)) {
+        return ALLOC_FAIL;
+    }
+
+    _mem_pool_lock_read(poolMgr);
+    _mem_drain_remote_frees(poolMgr);
+    alloc_status status = _mem_set_pinned(poolMgr, alloc, 0);
+    _mem_pool_unlock(poolMgr);
+
+    return status;
+}
+
+void mem_inspect_pool(pool_pt pool,
+                      pool_segment_pt *segments,
+                      unsigned *num_segments) {
+    if (((pool_mgr_pt) pool)->num_shards > 0) {
+        _mem_shard_inspect((pool_mgr_pt) pool, segments, num_segments);
+        return;
+    }
+
+    // note: the deferred frees stay allocations, as inspecting the pool
+    // does not change it; mem_pool_maintain() coalesces them
+    _mem_pool_lock_read((pool_mgr_pt) pool);
+    _mem_drain_remote_frees((pool_mgr_pt) pool);
+    _mem_inspect_pool(pool, segments, num_segments);
+    _mem_pool_unlock((pool_mgr_pt) pool);
+}
+
+alloc_status mem_inspect_pool_snapshot(pool_pt pool,
+                                       pool_segment_pt *segments,
+                                       unsigned *num_segments) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    pool_segment_pt segmentArray = NULL;
+    unsigned numSegments = 0;
+
+    // take the snapshot without the lock, so the threads using the pool
+    // never wait for it
+    // note: sharded pools take one of each shard in turn, without the
+    // allocations it lent, so each shard is consistent on its own only
+    if (poolMgr->num_shards > 0) {
+        for (unsigned s = 0; s < poolMgr->num_shards; ++s) {
+            if (_mem_snapshot(poolMgr->shards[s], poolMgr, s, &segmentArray, &numSegments) != ALLOC_OK) {
+                free(segmentArray);
+                return ALLOC_FAIL;
+            }
+        }
+    } else if (_mem_snapshot(poolMgr, NULL, 0, &segmentArray, &numSegments) != ALLOC_OK) {
+        free(segmentArray);
+        return ALLOC_FAIL;
+    }
+
+    // "return" the values:
+    *segments = segmentArray;
+    *num_segments = numSegments;
+
+    return ALLOC_OK;
+}
+
+
+
+/***********************************/
+/*                                 */
+/* Definitions of static functions */
+/*                                 */
+/***********************************/
+// the user-facing functions on a pool take its lock, and call these
+static alloc_status _mem_pool_reset(pool_pt pool) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    // check if this pool is allocated
+    if (poolMgr == NULL) {
+        return ALLOC_FAIL;
+    }
+
+    // drop all allocations from the metadata, and the deferred frees and
+    // quick lists
+    // note: the blocks on the quick lists and in the thread caches were
+    // counted as deallocations already
+    poolMgr->total_frees += poolMgr->pool.num_allocs - _mem_cached_blocks(poolMgr);
+    poolMgr->pool.alloc_size = 0;
+    poolMgr->pool.num_allocs = 0;
+    poolMgr->num_deferred = 0;
+    for (unsigned l = 0; l < MEM_QUICK_LIST_COUNT; ++l) {
+        for (unsigned q = 0; q < poolMgr->quick_count[l]; ++q) {
+            poolMgr->quick_nodes[l * poolMgr->quick_capacity + q]->quick = 0;
+        }
+        poolMgr->quick_count[l] = 0;
+    }
+    poolMgr->num_quick = 0;
+    poolMgr->compact_cursor = NULL;
+
+    // the blocks in the thread caches are dropped with them
+    for (unsigned t = 0; poolMgr->thread_caches != NULL && t < MEM_THREAD_CACHE_MAX_THREADS; ++t) {
+        if (poolMgr->thread_caches[t] != NULL) {
+            memset(poolMgr->thread_caches[t]->count, 0, sizeof(poolMgr->thread_caches[t]->count));
+            _mem_count_reset(poolMgr->thread_caches[t]);
+        }
+    }
+
+    // arena pools only need the bump pointer back at the start
+    if (poolMgr->pool.policy == ARENA) {
+        poolMgr->arena_top = 0;
+        poolMgr->pool.num_gaps = 1;
+        return ALLOC_OK;
+    }
+
+    // slab pools clear the bitmap, and start bumping from the first slot
+    if (poolMgr->pool.policy == SLAB) {
+        for (unsigned w = 0; w < (poolMgr->slab_count + 63) / 64; ++w) {
+            poolMgr->slab_map[w] = 0;
+        }
+        poolMgr->slab_free = MEM_GAP_IX_NIL;
+        poolMgr->slab_bump = 0;
+        poolMgr->pool.num_gaps = 1;
+        return ALLOC_OK;
+    }
+
+    // boundary-tag pools start over with a single free block
+    if (poolMgr->pool.policy == BOUNDARY_TAG) {
+        for (unsigned c = 0; c < MEM_GAP_CLASS_COUNT; ++c) {
+            poolMgr->tag_class_head[c] = NULL;
+        }
+        poolMgr->gap_class_map = 0;
+        poolMgr->largest_gap = 0;
+        poolMgr->largest_gap_exact = 1;
+        poolMgr->largest_gap_count = 0;
+        poolMgr->pool.num_gaps = 0;
+        for (unsigned c = 0; c < MEM_STATS_GAP_CLASSES; ++c) {
+            poolMgr->gap_histogram[c] = 0;
+        }
+        _mem_tag_open(poolMgr);
+        return ALLOC_OK;
+    }
+
+    // put every node but the first one of each extent back on the free
+    // node list
+    node_pt node = poolMgr->node_heap->next;
+    while (node != NULL) {
+        node_pt next = node->next;
+        if (! node->extent_start) {
+            node->prev = NULL;
+            _mem_release_node(poolMgr, node);
+        }
+        node = next;
+    }
+
+    // empty the gap index
+    if (_mem_invalidate_gap_ix(poolMgr) != ALLOC_OK) {
+        return ALLOC_FAIL;
+    }
+
+    //   each extent is a single gap again, as in mem_pool_open
+    for (unsigned e = 0; e < poolMgr->num_extents; e++) {
+        node = poolMgr->extents[e].first;
+        node->allocated = 0;
+        node->pinned = 0;
+        node->alloc_record.mem = poolMgr->extents[e].mem;
+        node->alloc_record.size = poolMgr->extents[e].size;
+        node->prev = (e > 0) ? poolMgr->extents[e - 1].first : NULL;
+        node->next = (e + 1 < poolMgr->num_extents) ? poolMgr->extents[e + 1].first : NULL;
+        if (_mem_add_to_gap_ix(poolMgr, node->alloc_record.size, node) != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+    }
+
+    return ALLOC_OK;
+}
+
+static void * _mem_new_alloc(pool_pt pool, size_t size, size_t alignment) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    // the alignment has to be a power of two
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    // slab pools hand out fixed-size slots
+    // note: either every slot is aligned, or they cannot all be
+    if (poolMgr->pool.policy == SLAB) {
+        if (poolMgr->slab_slot_size % alignment != 0 ||
+            _mem_align_padding(poolMgr->pool.mem, alignment) != 0) {
+            return NULL;
+        }
+        return _mem_slab_new_alloc(poolMgr, size);
+    }
+
+    // arena pools bump a pointer
+    if (poolMgr->pool.policy == ARENA) {
+        return _mem_arena_new_alloc(poolMgr, size, alignment);
+    }
+
+    // boundary-tag pools carve tagged blocks out of the pool memory
+    if (poolMgr->pool.policy == BOUNDARY_TAG) {
+        return _mem_tag_new_alloc(poolMgr, size, alignment);
+    }
+
+    // check if any gaps, return null if none
+    if (poolMgr->gap_ix_capacity == 0){
+        return NULL;
+    }
+
+    // expand heap node, if necessary, quit on error
+    if (_mem_resize_node_heap(poolMgr) !=ALLOC_OK){
+        return NULL;
+    }
+
+    // check used nodes fewer than total nodes, quit on error
+    if (poolMgr->total_nodes <= poolMgr->used_nodes){
+        return NULL;
+    }
+
+    // buddy pools allocate whole power-of-two blocks
+    // note: a block is aligned to its size, if the pool is
+    if (poolMgr->pool.policy == BUDDY) {
+        if (_mem_align_padding(poolMgr->pool.mem, alignment) != 0) {
+            return NULL;
+        }
+        void *block = _mem_buddy_new_alloc(poolMgr, (size < alignment) ? alignment : size);
+        if (block == NULL && poolMgr->num_deferred > 0) {
+            // the deferred frees may merge into a large enough block
+            _mem_drain_deferred_frees(poolMgr);
+            return _mem_new_alloc(pool, size, alignment);
+        }
+        if (block != NULL) {
+            ((node_pt) block)->align_shift = _mem_align_shift(alignment);
+        }
+        return block;
+    }
+
+    // get a node for allocation:
+    node_pt nodeForAlloc = NULL;
+
+    // the size that holds the allocation at any alignment
+    size_t classSize = size + (alignment - 1);
+    if (classSize < size) {
+        return NULL;
+    }
+
+    // a node freed to the quick list of the size is handed out again as
+    // it is, without a split
+    // note: only unaligned allocations, as its start is wherever it was
+    if (poolMgr->num_quick > 0 && alignment == 1) {
+        node_pt quickNode = _mem_quick_new_alloc(poolMgr, size);
+        if (quickNode != NULL) {
+            return (alloc_pt) quickNode;
+        }
+    }
+
+    // find a sufficient gap in the gap index, as per the policy
+    unsigned gapIx = _mem_find_policy_gap_ix(poolMgr, size, alignment);
+
+    // check if node found
+    // note: a growable pool adds an extent that holds the size at any
+    // alignment instead, at least as large as the pool so far
+    if (gapIx == MEM_GAP_IX_NIL) {
+        // the deferred frees and the quick lists may coalesce into a
+        // sufficient gap, so look again once they are
+        if (poolMgr->num_deferred > 0 || poolMgr->num_quick > 0) {
+            _mem_drain_deferred_frees(poolMgr);
+            _mem_drain_quick_lists(poolMgr);
+            return _mem_new_alloc(pool, size, alignment);
+        }
+        if (! poolMgr->growable) {
+            return NULL;
+        }
+        size_t extentSize = (classSize > poolMgr->pool.total_size) ?
+                            classSize : poolMgr->pool.total_size;
+        node_pt extentNode = _mem_add_extent(poolMgr, extentSize, NULL);
+        if (extentNode == NULL) {
+            return NULL;
+        }
+        gapIx = extentNode->gap_ix_pos;
+    }
+    nodeForAlloc = poolMgr->gap_ix[gapIx].node;
+
+    // if the gap is not aligned, the padding in front stays a gap, and
+    // the allocation takes a new node right after it; what is left after
+    // the allocation becomes another gap
+    size_t padding = _mem_align_padding(nodeForAlloc->alloc_record.mem, alignment);
+    size_t remainingSize = nodeForAlloc->alloc_record.size - padding - size;
+
+    // claim the nodes of the split, make room in the gap index for the
+    // gaps it adds, and take the gap out of the gap index, before the pool
+    // is changed, so a failure leaves the pool as it was
+    // note: the split takes one gap out and puts at most two back, so the
+    // gap index grows by one entry at most
+    node_pt paddingNode = NULL;
+    node_pt newGapNode = NULL;
+    if (padding > 0) {
+        paddingNode = nodeForAlloc;
+        nodeForAlloc = _mem_claim_node(poolMgr);
+        if (nodeForAlloc == NULL) {
+            return NULL;
+        }
+    }
+    if (remainingSize > 0) {
+        newGapNode = _mem_claim_node(poolMgr);
+    }
+    node_pt gapNode = (paddingNode != NULL) ? paddingNode : nodeForAlloc;
+    if ((remainingSize > 0 && newGapNode == NULL) ||
+        _mem_resize_gap_ix(poolMgr) != ALLOC_OK ||
+        _mem_remove_from_gap_ix(poolMgr, gapNode->alloc_record.size, gapNode) != ALLOC_OK) {
+        if (newGapNode != NULL) {
+            _mem_release_node(poolMgr, newGapNode);
+        }
+        if (paddingNode != NULL) {
+            _mem_release_node(poolMgr, nodeForAlloc);
+        }
+        return NULL;
+    }
+
+    // split the padding off the front
+    if (paddingNode != NULL) {
+        nodeForAlloc->alloc_record.mem = paddingNode->alloc_record.mem + padding;
+        nodeForAlloc->alloc_record.size = paddingNode->alloc_record.size - padding;
+
+        nodeForAlloc->next = paddingNode->next;
+        nodeForAlloc->prev = paddingNode;
+        if (paddingNode->next != NULL) {
+            paddingNode->next->prev = nodeForAlloc;
+        }
+        paddingNode->next = nodeForAlloc;
+
+        paddingNode->alloc_record.size = padding;
+        _mem_add_to_gap_ix(poolMgr, padding, paddingNode);
+    }
+
+    // update metadata (num_allocs, alloc_size)
+    poolMgr->pool.num_allocs++;
+    poolMgr->pool.alloc_size = poolMgr->pool.alloc_size + size;
+    poolMgr->total_allocs++;
+    _mem_stats_peak(poolMgr);
+
+    // convert gap_node to an allocation node of given size
+    nodeForAlloc->alloc_record.size = size;
+    nodeForAlloc->allocated = 1;
+    nodeForAlloc->align_shift = _mem_align_shift(alignment);
+    _mem_page_map_set(poolMgr, nodeForAlloc);
+
+    // adjust node heap:
+    //   if remaining gap, the node claimed for it becomes a gap node
+    if (newGapNode != NULL){
+        //   initialize it to a gap node
+        newGapNode->alloc_record.size = remainingSize;
+        newGapNode->alloc_record.mem = nodeForAlloc->alloc_record.mem + size;
+        newGapNode->allocated = 0;
+
+        //   update linked list (new node right after the node for allocation)
+        newGapNode->next = nodeForAlloc->next;
+        newGapNode->prev = nodeForAlloc;
+        if (nodeForAlloc->next != NULL){
+            nodeForAlloc->next->prev = newGapNode;
+        }
+        nodeForAlloc->next = newGapNode;
+
+        //   add to gap index
+        _mem_add_to_gap_ix(poolMgr, newGapNode->alloc_record.size, newGapNode);
+    }
+
+    // return allocation record by casting the node to (alloc_pt)
+    return (alloc_pt)nodeForAlloc;
+}
+
+// allocates the sizes in order, and returns how many were allocated
+// before the first that failed; carves as many as fit out of each gap,
+// so the gap is taken out of the gap index, and what is left of it put
+// back, once for all of them
+// note: the pools that do not keep a gap index allocate one at a time
+static unsigned _mem_new_alloc_batch(pool_mgr_pt pool_mgr,
+                                     const size_t *sizes,
+                                     unsigned n,
+                                     void **allocs) {
+    unsigned numAllocs = 0;
+    if (pool_mgr->pool.policy != FIRST_FIT && pool_mgr->pool.policy != BEST_FIT &&
+        pool_mgr->pool.policy != SEGREGATED_FIT && pool_mgr->pool.policy != TLSF) {
+        while (numAllocs < n &&
+               (allocs[numAllocs] = _mem_new_alloc((pool_pt) pool_mgr, sizes[numAllocs], 1)) != NULL) {
+            numAllocs++;
+        }
+        return numAllocs;
+    }
+
+    unsigned carved = 0;
+    size_t carvedSize = 0;
+    while (numAllocs < n) {
+        // find a gap for as many of the next sizes as possible: all of
+        // them first, halving the count until one does
+        unsigned count = n - numAllocs;
+        unsigned gapIx = MEM_GAP_IX_NIL;
+        for (;;) {
+            size_t batchSize = 0;
+            unsigned i = 0;
+            while (i < count && batchSize + sizes[numAllocs + i] >= batchSize) {
+                batchSize += sizes[numAllocs + i];
+                i++;
+            }
+            if (i == count) {
+                gapIx = _mem_find_policy_gap_ix(pool_mgr, batchSize, 1);
+            }
+            if (gapIx != MEM_GAP_IX_NIL || count == 1) {
+                break;
+            }
+            count = count / 2;
+        }
+
+        // no gap holds the next size: allocate it the usual way, which
+        // coalesces the deferred frees or grows the pool, if it can
+        if (gapIx == MEM_GAP_IX_NIL) {
+            allocs[numAllocs] = _mem_new_alloc((pool_pt) pool_mgr, sizes[numAllocs], 1);
+            if (allocs[numAllocs] == NULL) {
+                break;
+            }
+            numAllocs++;
+            continue;
+        }
+
+        // claim the nodes for the allocations after the first, and for
+        // what is left of the gap, before the gap is taken
+        // check success, on error put them back and stop
+        node_pt claimed = NULL;
+        unsigned numClaimed = 0;
+        while (numClaimed < count) {
+            node_pt node = _mem_claim_node(pool_mgr);
+            if (node == NULL) {
+                break;
+            }
+            node->next = claimed;
+            claimed = node;
+            numClaimed++;
+        }
+        if (numClaimed < count) {
+            while (claimed != NULL) {
+                node_pt next = claimed->next;
+                _mem_release_node(pool_mgr, claimed);
+                claimed = next;
+            }
+            break;
+        }
+
+        // remove the gap from the gap index
+        node_pt gapNode = pool_mgr->gap_ix[gapIx].node;
+        _mem_remove_from_gap_ix(pool_mgr, gapNode->alloc_record.size, gapNode);
+        size_t remainingSize = gapNode->alloc_record.size;
+
+        // convert the gap node to the first allocation, and link a claimed
+        // node after the last one for each of the others
+        node_pt node = gapNode;
+        for (unsigned i = 0; i < count; ++i) {
+            if (i > 0) {
+                node_pt newNode = claimed;
+                claimed = claimed->next;
+                newNode->alloc_record.mem = node->alloc_record.mem + node->alloc_record.size;
+                newNode->next = node->next;
+                newNode->prev = node;
+                if (node->next != NULL) {
+                    node->next->prev = newNode;
+                }
+                node->next = newNode;
+                node = newNode;
+            }
+            node->alloc_record.size = sizes[numAllocs];
+            node->allocated = 1;
+            node->align_shift = 0;
+            _mem_page_map_set(pool_mgr, node);
+            remainingSize -= sizes[numAllocs];
+            carvedSize += sizes[numAllocs];
+            allocs[numAllocs] = node;
+            numAllocs++;
+        }
+        carved += count;
+
+        // the rest of the gap, if any, takes the last claimed node
+        node_pt newGapNode = claimed;
+        if (remainingSize > 0) {
+            newGapNode->alloc_record.mem = node->alloc_record.mem + node->alloc_record.size;
+            newGapNode->alloc_record.size = remainingSize;
+            newGapNode->next = node->next;
+            newGapNode->prev = node;
+            if (node->next != NULL) {
+                node->next->prev = newGapNode;
+            }
+            node->next = newGapNode;
+            if (_mem_add_to_gap_ix(pool_mgr, remainingSize, newGapNode) != ALLOC_OK) {
+                break;
+            }
+        } else {
+            _mem_release_node(pool_mgr, newGapNode);
+        }
+    }
+
+    // update metadata (num_allocs, alloc_size), once for the carved ones
+    pool_mgr->pool.num_allocs += carved;
+    pool_mgr->pool.alloc_size += carvedSize;
+    pool_mgr->total_allocs += carved;
+    _mem_stats_peak(pool_mgr);
+
+    return numAllocs;
+}
+
+static alloc_status _mem_del_alloc(pool_pt pool, void *alloc) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    // slab pools take back the slot pointers they handed out
+    if (poolMgr->pool.policy == SLAB) {
+        return _mem_slab_del_alloc(poolMgr, alloc);
+    }
+    // arena allocations are only dropped all at once, by mem_pool_reset
+    if (poolMgr->pool.policy == ARENA) {
+        return ALLOC_FAIL;
+    }
+    // boundary-tag pools find the block, and its neighbours, from the tags
+    if (poolMgr->pool.policy == BOUNDARY_TAG) {
+        return _mem_tag_del_alloc(poolMgr, alloc);
+    }
+    // get node from alloc: a data pointer into the pool is looked up in
+    // the page map, anything else is the node itself
+    node_pt nodePt = _mem_alloc_node(poolMgr, alloc);
+    // find the node in the node heap
+    // this is node-to-delete (nodePt)
+    // make sure it's found
+    if(nodePt == NULL){
+        return ALLOC_FAIL;
+    }
+    // a data pointer has to be the start of the allocation
+    if (nodePt != alloc && nodePt->alloc_record.mem != alloc) {
+        return ALLOC_FAIL;
+    }
+    // a node that is not an allocation, or is on a quick list or in a
+    // thread cache, is freed already
+    if (! nodePt->used || ! nodePt->allocated || nodePt->quick || nodePt->cached) {
+        return ALLOC_FAIL;
+    }
+    // with quick lists, the node goes on the list of its size, if it can,
+    // and stays allocated until the list is coalesced
+    if (poolMgr->quick_capacity > 0 && _mem_quick_del_alloc(poolMgr, nodePt) == ALLOC_OK) {
+        return ALLOC_OK;
+    }
+    // in deferred mode, the node stays allocated until the pool is
+    // maintained, and is coalesced only then
+    if (poolMgr->defer_frees) {
+        return _mem_defer_free(poolMgr, nodePt);
+    }
+    return _mem_free_node(poolMgr, nodePt);
+}
+
+// deallocates all the allocations, and returns ALLOC_FAIL if any of them
+// was not one, after deallocating the others; the pools that keep a gap
+// index coalesce them in a batch
+// note: the pools that do not, and pools that defer their frees anyway,
+// deallocate one at a time
+static alloc_status _mem_del_alloc_batch(pool_mgr_pt pool_mgr, void **allocs, unsigned n) {
+    alloc_status status = ALLOC_OK;
+    node_pt *nodes = NULL;
+    if ((pool_mgr->pool.policy == FIRST_FIT || pool_mgr->pool.policy == BEST_FIT ||
+         pool_mgr->pool.policy == SEGREGATED_FIT || pool_mgr->pool.policy == TLSF) &&
+        ! pool_mgr->defer_frees && n > 0) {
+        nodes = malloc(sizeof(node_pt) * n);
+    }
+    if (nodes == NULL) {
+        for (unsigned i = 0; i < n; ++i) {
+            if (_mem_del_alloc((pool_pt) pool_mgr, allocs[i]) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+        }
+        return status;
+    }
+
+    // get the node of each allocation, as in mem_del_alloc
+    unsigned numNodes = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        node_pt node = _mem_alloc_node(pool_mgr, allocs[i]);
+        if (node == NULL || (node != allocs[i] && node->alloc_record.mem != allocs[i])) {
+            status = ALLOC_FAIL;
+            continue;
+        }
+        nodes[numNodes] = node;
+        numNodes++;
+    }
+
+    if (_mem_free_nodes(pool_mgr, nodes, numNodes) != ALLOC_OK) {
+        status = ALLOC_FAIL;
+    }
+    free(nodes);
+
+    return status;
+}
+
+// converts the allocation node to a gap, and merges it with the gaps
+// before and after it
+static alloc_status _mem_free_node(pool_mgr_pt pool_mgr, node_pt node) {
+    // buddy pools only merge a block with its buddy
+    if (pool_mgr->pool.policy == BUDDY) {
+        return _mem_buddy_del_alloc(pool_mgr, node);
+    }
+    // convert to gap node
+    node->allocated = 0;
+    node->pinned = 0;
+    // update metadata (num_allocs, alloc_size)
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size = pool_mgr->pool.alloc_size - node->alloc_record.size;
+    pool_mgr->total_frees++;
+    // if the next node in the list is also a gap, merge into node-to-delete
+    // note: segments in different extents are not contiguous, so never merge
+    if (node->next !=NULL && node->next->allocated == 0 && node->next->used &&
+        ! node->next->extent_start){
+        node_pt next = node->next;
+        //   remove the next node from gap index
+        //   check success
+        if(_mem_remove_from_gap_ix(pool_mgr,next->alloc_record.size, next) != ALLOC_OK){
+            return ALLOC_FAIL;
+        }
+        //   add the size to the node-to-delete
+        node->alloc_record.size = node->alloc_record.size + next->alloc_record.size;
+        //   update linked list:
+
+        if (next->next) {
+            next->next->prev = node;
+            node->next = next->next;
+        } else {
+            node->next = NULL;
+        }
+        next->next = NULL;
+        next->prev = NULL;
+        //   update node as unused (and metadata (used nodes))
+        _mem_release_node(pool_mgr, next);
+    }
+    // this merged node-to-delete might need to be added to the gap index
+    // but one more thing to check...
+    // if the previous node in the list is also a gap, merge into previous!
+    if(node->prev != NULL && node->prev->allocated == 0 && node->prev->used &&
+       ! node->extent_start){
+        node_pt prev = node->prev;
+        //   remove the previous node from gap index
+        //   check success
+        if(_mem_remove_from_gap_ix(pool_mgr,prev->alloc_record.size, prev) != ALLOC_OK){
+            return ALLOC_FAIL;
+        }
+        //   add the size of node-to-delete to the previous
+        prev->alloc_record.size = prev->alloc_record.size + node->alloc_record.size;
+        //   update linked list
+        if (node->next) {
+            prev->next = node->next;
+            node->next->prev = prev;
+        } else {
+            prev->next = NULL;
+        }
+        node->next = NULL;
+        node->prev = NULL;
+        //   update node-to-delete as unused (and metadata (used_nodes))
+        _mem_release_node(pool_mgr, node);
+        // change the node to add to the previous node!
+        node = prev;
+    }
+    // add the resulting node to the gap index
+    // check success
+    if(_mem_add_to_gap_ix(pool_mgr, node->alloc_record.size, node) != ALLOC_OK){
+        return ALLOC_FAIL;
+    }
+    return ALLOC_OK;
+}
+
+static void * _mem_realloc(pool_pt pool, void *alloc, size_t size) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    // like realloc(), no allocation is a new one
+    if (alloc == NULL) {
+        return _mem_new_alloc(pool, size, 1);
+    }
+
+    switch (poolMgr->pool.policy) {
+        case SLAB:
+            // a slot holds any size up to the slot size, and no other
+            if (size > poolMgr->slab_slot_size || _mem_alloc_size(pool, alloc) == 0 ||
+                (size_t) ((char *) alloc - poolMgr->pool.mem) % poolMgr->slab_slot_size != 0) {
+                return NULL;
+            }
+            return alloc;
+        case ARENA:
+            // arena pools do not keep the sizes of their allocations
+            return NULL;
+        case BOUNDARY_TAG:
+            return _mem_tag_realloc(poolMgr, alloc, size);
+        default:
+            break;
+    }
+
+    // get node from alloc, as in mem_del_alloc
+    node_pt node = _mem_alloc_node(poolMgr, alloc);
+    if (node == NULL || ! node->used || ! node->allocated || node->quick || node->cached ||
+        (node != alloc && node->alloc_record.mem != alloc)) {
+        return NULL;
+    }
+    size_t oldSize = node->alloc_record.size;
+
+    if (poolMgr->pool.policy == BUDDY) {
+        // stays in place if the block for the new size is the same
+        size_t blockSize = MEM_BUDDY_MIN_BLOCK;
+        while (blockSize < size && blockSize < poolMgr->pool.total_size) {
+            blockSize <<= 1;
+        }
+        if (blockSize == oldSize) {
+            return alloc;
+        }
+    } else if (size <= oldSize) {
+        // shrink in place: the tail goes to the next gap, or is a new one
+        size_t tailSize = oldSize - size;
+        if (tailSize == 0) {
+            return alloc;
+        }
+        node_pt next = node->next;
+        if (next != NULL && ! next->allocated && ! next->extent_start) {
+            if (_mem_remove_from_gap_ix(poolMgr, next->alloc_record.size, next) != ALLOC_OK) {
+                return NULL;
+            }
+            next->alloc_record.mem -= tailSize;
+            next->alloc_record.size += tailSize;
+        } else {
+            next = _mem_claim_node(poolMgr);
+            if (next == NULL) {
+                return NULL;
+            }
+            next->alloc_record.mem = node->alloc_record.mem + size;
+            next->alloc_record.size = tailSize;
+            next->allocated = 0;
+            next->next = node->next;
+            next->prev = node;
+            if (node->next != NULL) {
+                node->next->prev = next;
+            }
+            node->next = next;
+        }
+        node->alloc_record.size = size;
+        poolMgr->pool.alloc_size -= tailSize;
+        if (_mem_add_to_gap_ix(poolMgr, next->alloc_record.size, next) != ALLOC_OK) {
+            return NULL;
+        }
+        return alloc;
+    } else if (node->next != NULL && ! node->next->allocated && ! node->next->extent_start &&
+               node->next->alloc_record.size >= size - oldSize) {
+        // grow in place, into the next gap
+        node_pt next = node->next;
+        size_t extraSize = size - oldSize;
+        if (_mem_remove_from_gap_ix(poolMgr, next->alloc_record.size, next) != ALLOC_OK) {
+            return NULL;
+        }
+        if (next->alloc_record.size == extraSize) {
+            node->next = next->next;
+            if (next->next != NULL) {
+                next->next->prev = node;
+            }
+            next->next = NULL;
+            _mem_release_node(poolMgr, next);
+        } else {
+            next->alloc_record.mem += extraSize;
+            next->alloc_record.size -= extraSize;
+            if (_mem_add_to_gap_ix(poolMgr, next->alloc_record.size, next) != ALLOC_OK) {
+                return NULL;
+            }
+        }
+        node->alloc_record.size = size;
+        poolMgr->pool.alloc_size += extraSize;
+        _mem_stats_peak(poolMgr);
+        _mem_page_map_set(poolMgr, node);
+        return alloc;
+    }
+
+    // relocate: allocate anew, at the alignment of the old, copy, and
+    // deallocate the old
+    node_pt newNode = (node_pt) _mem_new_alloc(pool, size, (size_t) 1 << node->align_shift);
+    if (newNode == NULL) {
+        return NULL;
+    }
+    memcpy(newNode->alloc_record.mem, node->alloc_record.mem, (size < oldSize) ? size : oldSize);
+    if (_mem_del_alloc(pool, node) != ALLOC_OK) {
+        return NULL;
+    }
+
+    // return the same kind of pointer as was passed in
+    return (node == alloc) ? (void *) newNode : (void *) newNode->alloc_record.mem;
+}
+
+static size_t _mem_alloc_size(pool_pt pool, void *alloc) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+    char *mem = alloc;
+
+    switch (poolMgr->pool.policy) {
+        case SLAB: {
+            // any pointer into an allocated slot
+            if (mem < poolMgr->pool.mem ||
+                mem >= poolMgr->pool.mem + poolMgr->pool.total_size) {
+                return 0;
+            }
+            unsigned slot = (unsigned) ((size_t) (mem - poolMgr->pool.mem) / poolMgr->slab_slot_size);
+            return ((poolMgr->slab_map[slot / 64] >> (slot % 64)) & 1) ?
+                   poolMgr->slab_slot_size : 0;
+        }
+        case ARENA:
+            // arena pools do not keep the sizes of their allocations
+            return 0;
+        case BOUNDARY_TAG: {
+            // the data pointer of an allocated block
+            char *block = _mem_tag_block(poolMgr, alloc);
+            return (block != NULL) ? _mem_tag_size(block) - 2 * MEM_TAG_SIZE : 0;
+        }
+        default: {
+            // any pointer into an allocation, or the node itself
+            node_pt node = _mem_alloc_node(poolMgr, alloc);
+            return (node != NULL && node->used && node->allocated &&
+                    ! node->quick && ! node->cached) ?
+                   node->alloc_record.size : 0;
+        }
+    }
+}
+
+static void _mem_inspect_pool(pool_pt pool,
+                              pool_segment_pt *segments,
+                              unsigned *num_segments) {
+    // get the mgr from the pool
+    pool_mgr_pt poolMgr = (pool_mgr_pt) pool;
+
+    // slab pools have no node list, so walk the bitmap instead
+    if (poolMgr->pool.policy == SLAB) {
+        _mem_slab_inspect(poolMgr, segments, num_segments);
+        return;
+    }
+
+    // arena pools do not keep the individual allocations
+    if (poolMgr->pool.policy == ARENA) {
+        _mem_arena_inspect(poolMgr, segments, num_segments);
+        return;
+    }
+
+    // boundary-tag pools walk the blocks by their headers
+    if (poolMgr->pool.policy == BOUNDARY_TAG) {
+        _mem_tag_inspect(poolMgr, segments, num_segments);
+        return;
+    }
+
+    // allocate the segments array with size == used_nodes
+    // check successful
+    pool_segment_pt segmentArray = calloc(poolMgr->used_nodes, sizeof(pool_segment_t));
+    if (segmentArray == NULL){
+        segments = NULL;
+        return;
+    }
+
+    // loop through the node heap and the segments array
+    //    for each node, write the size and allocated in the segment
+    node_pt currentNode = poolMgr->node_heap;
     for (int i = 0; i < poolMgr->used_nodes; i++){
         segmentArray[i].size = currentNode->alloc_record.size;
         segmentArray[i].allocated = currentNode->allocated;
@@ -476,76 +2366,2841 @@ void mem_inspect_pool(pool_pt pool,
 
     // "return" the values:
     *segments = segmentArray;
-    *num_segments = poolMgr->used_nodes;
+    *num_segments = poolMgr->used_nodes;
+}
+
+// takes a snapshot of the segments of the pool without its lock, and
+// appends them to the array: copies them, and starts over if a call on
+// the pool held the lock at any time in between
+// note: gives up after MEM_SNAPSHOT_MAX_RETRIES, as a busy pool may never
+// stay still for a whole copy; waiting for the lock counts as a retry
+static alloc_status _mem_snapshot(pool_mgr_pt pool_mgr,
+                                  pool_mgr_pt sharded,
+                                  unsigned shard,
+                                  pool_segment_pt *segments,
+                                  unsigned *num_segments) {
+    for (unsigned r = 0; r < MEM_SNAPSHOT_MAX_RETRIES; ++r) {
+        // wait for the lock to be released, giving its holder the processor
+        // note: an odd sequence number means the lock is held
+        unsigned seq = atomic_load_explicit(&pool_mgr->snapshot_seq, memory_order_acquire);
+        if (seq % 2 != 0) {
+#ifdef MEM_POOL_THREAD_SAFE
+            sched_yield();
+#endif
+            continue;
+        }
+
+        // make room for as many segments as the pool has now
+        // note: read without the lock, so only a bound for the copy
+        unsigned capacity = pool_mgr->used_nodes;
+        if (pool_mgr->pool.policy == ARENA) {
+            capacity = 2;
+        } else if (pool_mgr->pool.policy == SLAB || pool_mgr->pool.policy == BOUNDARY_TAG) {
+            capacity = pool_mgr->pool.num_allocs + pool_mgr->pool.num_gaps;
+        }
+        pool_segment_pt grown = realloc(*segments,
+                                        sizeof(pool_segment_t) * (*num_segments + capacity + 1));
+        if (grown == NULL) {
+            return ALLOC_FAIL;
+        }
+        *segments = grown;
+
+        // copy, and keep the copy if the sequence number did not change
+        unsigned copied = 0;
+        alloc_status status = _mem_snapshot_copy(pool_mgr, sharded, shard,
+                                                 *segments + *num_segments, capacity, &copied);
+        atomic_thread_fence(memory_order_acquire);
+        if (status == ALLOC_OK &&
+            atomic_load_explicit(&pool_mgr->snapshot_seq, memory_order_relaxed) == seq) {
+            *num_segments += copied;
+            return ALLOC_OK;
+        }
+    }
+
+    return ALLOC_FAIL;
+}
+
+// copies up to capacity segments of the pool, as _mem_inspect_pool does,
+// but while a call on the pool may be changing them: it only makes sure
+// to stay within the node heap and the pool memory, and returns
+// ALLOC_FAIL as soon as what it reads does not add up
+// note: a node pool reads its links from nodes that never move, and that
+// were zeroed before their first use, so a link is null or to a node
+static alloc_status _mem_snapshot_copy(pool_mgr_pt pool_mgr,
+                                       pool_mgr_pt sharded,
+                                       unsigned shard,
+                                       pool_segment_pt segments,
+                                       unsigned capacity,
+                                       unsigned *num_segments) {
+    unsigned s = 0;
+
+    // arena pools are the allocations, followed by the gap
+    if (pool_mgr->pool.policy == ARENA) {
+        size_t arenaTop = pool_mgr->arena_top;
+        if (arenaTop > pool_mgr->pool.total_size) {
+            return ALLOC_FAIL;
+        }
+        if (arenaTop > 0) {
+            segments[s].size = arenaTop;
+            segments[s].allocated = 1;
+            s++;
+        }
+        if (arenaTop < pool_mgr->pool.total_size) {
+            segments[s].size = pool_mgr->pool.total_size - arenaTop;
+            segments[s].allocated = 0;
+            s++;
+        }
+    }
+
+    // slab pools are runs of free slots and single allocated slots
+    else if (pool_mgr->pool.policy == SLAB) {
+        for (unsigned slot = 0; slot < pool_mgr->slab_count; ++slot) {
+            unsigned long allocated =
+                    (pool_mgr->slab_map[slot / 64] >> (slot % 64)) & 1;
+            if (allocated || s == 0 || segments[s - 1].allocated) {
+                if (s == capacity) {
+                    return ALLOC_FAIL;
+                }
+                segments[s].size = 0;
+                segments[s].allocated = allocated;
+                s++;
+            }
+            segments[s - 1].size += pool_mgr->slab_slot_size;
+        }
+    }
+
+    // boundary-tag pools are the blocks, by their headers
+    else if (pool_mgr->pool.policy == BOUNDARY_TAG) {
+        char *poolEnd = pool_mgr->pool.mem + pool_mgr->pool.total_size;
+        size_t blockSize;
+        for (char *block = pool_mgr->pool.mem; block < poolEnd; block += blockSize) {
+            blockSize = _mem_tag_size(block);
+            if (s == capacity || blockSize == 0 || blockSize % MEM_TAG_SIZE != 0 ||
+                blockSize > (size_t) (poolEnd - block)) {
+                return ALLOC_FAIL;
+            }
+            segments[s].size = blockSize;
+            segments[s].allocated = (unsigned long) _mem_tag_allocated(block);
+            s++;
+        }
+    }
+
+    // the other pools are the node list, without what a shard lent
+    else {
+        unsigned steps = 0;
+        for (node_pt node = pool_mgr->node_heap; node != NULL; node = node->next) {
+            if (steps++ == capacity) {
+                return ALLOC_FAIL;
+            }
+            if (sharded != NULL && node->allocated && _mem_shard_lent(sharded, shard, node)) {
+                continue;
+            }
+            segments[s].size = node->alloc_record.size;
+            segments[s].allocated = node->allocated;
+            s++;
+        }
+    }
+
+    *num_segments = s;
+    return ALLOC_OK;
+}
+
+// finds a slot of the pool store, allocating its chunk on first use
+// note: chunk c holds INIT_CAPACITY * EXPAND_FACTOR^c slots, and chunks
+// never move, so a slot can be used while another thread adds a chunk
+static store_slot_pt _mem_store_slot(unsigned slot) {
+    // find the chunk of the slot, and the position in it
+    unsigned chunk = 0;
+    size_t chunkCapacity = MEM_POOL_STORE_INIT_CAPACITY;
+    size_t pos = slot;
+    while (pos >= chunkCapacity) {
+        pos -= chunkCapacity;
+        chunkCapacity *= MEM_POOL_STORE_EXPAND_FACTOR;
+        if (++chunk == MEM_POOL_STORE_MAX_CHUNKS) {
+            return NULL;
+        }
+    }
+
+    // allocate the chunk, if not there yet
+    // note: of two threads adding the same chunk, the one that loses frees its own
+    store_slot_pt slots = atomic_load_explicit(&pool_store[chunk], memory_order_acquire);
+    if (slots == NULL) {
+        store_slot_pt newSlots = calloc(chunkCapacity, sizeof(store_slot_t));
+        if (newSlots == NULL) {
+            return NULL;
+        }
+        if (atomic_compare_exchange_strong_explicit(&pool_store[chunk], &slots, newSlots,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            slots = newSlots;
+        } else {
+            free(newSlots);
+        }
+    }
+
+    return &slots[pos];
+}
+
+// takes a slot for the mgr, the last one freed if any, or else the next
+// one never used, and puts the mgr in it
+// note: the free slot list is a stack which is popped with a compare and
+// swap, and its head carries a tag bumped on every change, so a slot
+// that is popped and pushed back in between is not mistaken for the same
+// head
+static alloc_status _mem_link_pool_store(pool_mgr_pt pool_mgr) {
+    // pop the free slot list, or take the next slot
+    unsigned slot;
+    uint_least64_t head = atomic_load_explicit(&pool_store_free, memory_order_acquire);
+    for (;;) {
+        unsigned top = (unsigned) (head & UINT32_MAX);
+        if (top == 0) {
+            slot = atomic_fetch_add_explicit(&pool_store_size, 1, memory_order_relaxed);
+            break;
+        }
+        unsigned next = atomic_load_explicit(&_mem_store_slot(top - 1)->next_free,
+                                             memory_order_relaxed);
+        uint_least64_t newHead = (((head >> 32) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&pool_store_free, &head, newHead,
+                                                  memory_order_acquire, memory_order_acquire)) {
+            slot = top - 1;
+            break;
+        }
+    }
+
+    // put the mgr in the slot
+    // note: a slot past the last chunk, or whose chunk fails to allocate, is lost
+    store_slot_pt storeSlot = _mem_store_slot(slot);
+    if (storeSlot == NULL) {
+        return ALLOC_FAIL;
+    }
+    pool_mgr->store_slot = slot;
+    atomic_store_explicit(&storeSlot->mgr, pool_mgr, memory_order_release);
+    atomic_fetch_add_explicit(&pool_store_count, 1, memory_order_relaxed);
+
+    return ALLOC_OK;
+}
+
+// sets the slot of the mgr to null and pushes it on the free slot list,
+// for the next pool opened to take
+// note: don't decrement pool_store_size, because it only grows
+static void _mem_release_pool_store(pool_mgr_pt pool_mgr) {
+    // a mgr that failed to open was never linked
+    if (pool_mgr->store_slot == MEM_POOL_STORE_NIL) {
+        return;
+    }
+    unsigned slot = pool_mgr->store_slot;
+    store_slot_pt storeSlot = _mem_store_slot(slot);
+    atomic_store_explicit(&storeSlot->mgr, NULL, memory_order_relaxed);
+
+    // push the slot on the free slot list
+    uint_least64_t head = atomic_load_explicit(&pool_store_free, memory_order_relaxed);
+    uint_least64_t newHead;
+    do {
+        atomic_store_explicit(&storeSlot->next_free, (unsigned) (head & UINT32_MAX),
+                              memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | (slot + 1);
+    } while (! atomic_compare_exchange_weak_explicit(&pool_store_free, &head, newHead,
+                                                     memory_order_release, memory_order_relaxed));
+    atomic_fetch_sub_explicit(&pool_store_count, 1, memory_order_release);
+}
+
+// frees everything of a pool that was checked to be closed, and takes it
+// out of the pool store
+static void _mem_pool_free(pool_mgr_pt pool_mgr) {
+    // free memory pool
+    free(pool_mgr->pool.mem);
+
+    // free node heap
+    for (unsigned i = 0; i < pool_mgr->num_node_blocks; i++) {
+        free(pool_mgr->node_blocks[i]);
+    }
+    free(pool_mgr->node_blocks);
+    _mem_chunk_ix_free(pool_mgr);
+
+    // free the extents added as the pool grew, and the page maps
+    // note: borrowed extents go back with the shard that lent them
+    for (unsigned e = 0; e < pool_mgr->num_extents; e++) {
+        if (e > 0 && ! pool_mgr->extents[e].borrowed) {
+            free(pool_mgr->extents[e].mem);
+        }
+        free(pool_mgr->extents[e].page_map);
+    }
+    free(pool_mgr->extents);
+    free(pool_mgr->extent_order);
+
+    // free the thread caches
+    _mem_free_thread_caches(pool_mgr);
+
+    // free gap index
+    free(pool_mgr->gap_ix);
+
+    // free slab occupancy bitmap
+    free(pool_mgr->slab_map);
+
+    // free the deferred free queue and the quick lists
+    free(pool_mgr->deferred_frees);
+    free(pool_mgr->quick_nodes);
+
+    // find mgr in pool store and set to null
+    _mem_release_pool_store(pool_mgr);
+
+    // free mgr
+    _mem_pool_sync_destroy(pool_mgr);
+    free(pool_mgr);
+}
+
+// in thread-safe builds, the pool store has a lock of its own, only taken
+// by mem_init and mem_free, and for thread indices, since pools take and
+// give back their slots with atomics, and each pool has a lock for the
+// calls on it, so threads on different pools never wait for each other;
+// otherwise these do nothing
+static void _mem_store_lock() {
+#ifdef MEM_POOL_THREAD_SAFE
+    pthread_mutex_lock(&pool_store_lock);
+#endif
+}
+
+static void _mem_store_unlock() {
+#ifdef MEM_POOL_THREAD_SAFE
+    pthread_mutex_unlock(&pool_store_lock);
+#endif
+}
+
+// sets up the lock of the pool, and the remote-free queue that the
+// opening thread, as the owner, drains
+static alloc_status _mem_pool_sync_init(pool_mgr_pt pool_mgr) {
+    atomic_init(&pool_mgr->snapshot_seq, 0);
+#ifdef MEM_POOL_THREAD_SAFE
+    pool_mgr->remote_frees = malloc(sizeof(remote_free_t) * MEM_REMOTE_FREE_CAPACITY);
+    if (pool_mgr->remote_frees == NULL) {
+        return ALLOC_FAIL;
+    }
+    if (pthread_mutex_init(&pool_mgr->lock, NULL) != 0) {
+        free(pool_mgr->remote_frees);
+        return ALLOC_FAIL;
+    }
+    for (size_t i = 0; i < MEM_REMOTE_FREE_CAPACITY; ++i) {
+        atomic_init(&pool_mgr->remote_frees[i].seq, i);
+    }
+    atomic_init(&pool_mgr->remote_tail, 0);
+    pool_mgr->remote_head = 0;
+    pool_mgr->owner = pthread_self();
+#endif
+    return ALLOC_OK;
+}
+
+static void _mem_pool_sync_destroy(pool_mgr_pt pool_mgr) {
+#ifdef MEM_POOL_THREAD_SAFE
+    pthread_mutex_destroy(&pool_mgr->lock);
+    free(pool_mgr->remote_frees);
+#else
+    (void) pool_mgr; /* unused */
+#endif
+}
+
+// takes the lock for a call that changes the segments of the pool: the
+// node list, the gap index, or the blocks of a pool without nodes
+static void _mem_pool_lock(pool_mgr_pt pool_mgr) {
+    _mem_pool_lock_read(pool_mgr);
+    _mem_pool_change(pool_mgr);
+}
+
+// takes the lock for a call that only reads the segments of the pool, so
+// that a snapshot taken meanwhile does not have to start over
+static void _mem_pool_lock_read(pool_mgr_pt pool_mgr) {
+#ifdef MEM_POOL_THREAD_SAFE
+    pthread_mutex_lock(&pool_mgr->lock);
+#else
+    (void) pool_mgr; /* unused */
+#endif
+}
+
+// the sequence number is odd from the first change to the segments until
+// the lock is released, so that a snapshot can tell if it overlapped with
+// a change; a call that only reads them leaves it as it is
+// note: only the holder of the lock writes it
+static void _mem_pool_change(pool_mgr_pt pool_mgr) {
+#ifdef MEM_POOL_THREAD_SAFE
+    unsigned seq = atomic_load_explicit(&pool_mgr->snapshot_seq, memory_order_relaxed);
+    if (seq % 2 == 0) {
+        atomic_store_explicit(&pool_mgr->snapshot_seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+#else
+    (void) pool_mgr; /* unused */
+#endif
+}
+
+// note: a shard hands the changes in its counts to its sharded pool while
+// it still holds its own lock, so that they arrive in order
+static void _mem_pool_unlock(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->parent != NULL) {
+        _mem_shard_report(pool_mgr);
+    }
+#ifdef MEM_POOL_THREAD_SAFE
+    unsigned seq = atomic_load_explicit(&pool_mgr->snapshot_seq, memory_order_relaxed);
+    if (seq % 2 != 0) {
+        atomic_store_explicit(&pool_mgr->snapshot_seq, seq + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&pool_mgr->lock);
+#endif
+}
+
+// queues a deallocation by a thread other than the owner, without the
+// lock: takes the next position with a compare-and-swap, fills the cell,
+// and then publishes it; returns ALLOC_FAIL if the caller is the owner,
+// or the queue is full, so the deallocation has to take the lock
+// note: only a handle of the pool that is allocated is queued, so that a
+// bad pointer fails right away; a data pointer needs the page map, so
+// the lock; a handle queued twice fails as it is drained, and is counted
+static alloc_status _mem_remote_free(pool_mgr_pt pool_mgr, void *alloc) {
+#ifdef MEM_POOL_THREAD_SAFE
+    if (pool_mgr->pool.policy == ARENA || pthread_equal(pthread_self(), pool_mgr->owner)) {
+        return ALLOC_FAIL;
+    }
+    node_pt node = _mem_chunk_ix_find(pool_mgr, alloc);
+    if (node == NULL || ! node->used || ! node->allocated || node->quick || node->cached) {
+        return ALLOC_FAIL;
+    }
+
+    remote_free_pt cell;
+    size_t pos = atomic_load_explicit(&pool_mgr->remote_tail, memory_order_relaxed);
+    for (;;) {
+        cell = &pool_mgr->remote_frees[pos & (MEM_REMOTE_FREE_CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        if (seq == pos) {
+            // the cell is free for this position, try to take it
+            if (atomic_compare_exchange_weak_explicit(&pool_mgr->remote_tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos) {
+            // the cell still holds a deallocation from the last round
+            return ALLOC_FAIL;
+        } else {
+            // another thread took the position
+            pos = atomic_load_explicit(&pool_mgr->remote_tail, memory_order_relaxed);
+        }
+    }
+    cell->alloc = alloc;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return ALLOC_OK;
+#else
+    (void) pool_mgr; /* unused */
+    (void) alloc; /* unused */
+    return ALLOC_FAIL;
+#endif
+}
+
+// deallocates everything in the remote-free queue, in one batch under the
+// lock that the caller holds
+static void _mem_drain_remote_frees(pool_mgr_pt pool_mgr) {
+#ifdef MEM_POOL_THREAD_SAFE
+    for (;;) {
+        size_t pos = pool_mgr->remote_head;
+        remote_free_pt cell = &pool_mgr->remote_frees[pos & (MEM_REMOTE_FREE_CAPACITY - 1)];
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) {
+            return;
+        }
+        void *alloc = cell->alloc;
+
+        // the cell is free again for the next round
+        atomic_store_explicit(&cell->seq, pos + MEM_REMOTE_FREE_CAPACITY, memory_order_release);
+        pool_mgr->remote_head = pos + 1;
+
+        // a call that only reads the pool changes it from here on
+        _mem_pool_change(pool_mgr);
+        if (_mem_del_alloc((pool_pt) pool_mgr, alloc) != ALLOC_OK) {
+            pool_mgr->remote_failures++;
+        }
+    }
+#else
+    (void) pool_mgr; /* unused */
+#endif
+}
+
+// queues the allocation node to be freed as the pool is maintained; it
+// stays allocated until then
+// note: if the queue cannot grow, the node is freed right away instead
+static alloc_status _mem_defer_free(pool_mgr_pt pool_mgr, node_pt node) {
+    if (! node->used || ! node->allocated) {
+        return ALLOC_FAIL;
+    }
+
+    // expand the queue, if necessary
+    if (pool_mgr->num_deferred == pool_mgr->deferred_capacity) {
+        unsigned newCapacity = (pool_mgr->deferred_capacity == 0) ?
+                               MEM_DEFERRED_INIT_CAPACITY :
+                               pool_mgr->deferred_capacity * MEM_DEFERRED_EXPAND_FACTOR;
+        node_pt *deferredFrees = realloc(pool_mgr->deferred_frees, sizeof(node_pt) * newCapacity);
+        if (deferredFrees == NULL) {
+            return _mem_free_node(pool_mgr, node);
+        }
+        pool_mgr->deferred_frees = deferredFrees;
+        pool_mgr->deferred_capacity = newCapacity;
+    }
+
+    pool_mgr->deferred_frees[pool_mgr->num_deferred] = node;
+    pool_mgr->num_deferred++;
+    return ALLOC_OK;
+}
+
+// coalesces the deferred frees in a batch
+static alloc_status _mem_drain_deferred_frees(pool_mgr_pt pool_mgr) {
+    unsigned numDeferred = pool_mgr->num_deferred;
+    pool_mgr->num_deferred = 0;
+
+    // buddy pools only merge a block with its buddy, one at a time
+    if (pool_mgr->pool.policy == BUDDY) {
+        alloc_status status = ALLOC_OK;
+        for (unsigned d = 0; d < numDeferred; ++d) {
+            if (_mem_buddy_del_alloc(pool_mgr, pool_mgr->deferred_frees[d]) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+        }
+        return status;
+    }
+
+    return _mem_free_nodes(pool_mgr, pool_mgr->deferred_frees, numDeferred);
+}
+
+// frees the allocation nodes in a batch: converts them all to gaps first,
+// and then merges each run of gaps they are in, so that a run is taken
+// out of and put back into the gap index once, however many of its
+// segments were freed
+// note: the runs are found through the node list, so the nodes need no
+// sorting, and a node given twice fails the second time, as it would
+// one at a time
+static alloc_status _mem_free_nodes(pool_mgr_pt pool_mgr, node_pt *nodes, unsigned n) {
+    alloc_status status = ALLOC_OK;
+
+    // convert to gap nodes, not in the gap index yet
+    // update metadata (num_allocs, alloc_size)
+    for (unsigned d = 0; d < n; ++d) {
+        node_pt node = nodes[d];
+        if (! node->used || ! node->allocated || node->quick || node->cached) {
+            status = ALLOC_FAIL;
+            continue;
+        }
+        node->allocated = 0;
+        node->pinned = 0;
+        pool_mgr->pool.num_allocs--;
+        pool_mgr->pool.alloc_size = pool_mgr->pool.alloc_size - node->alloc_record.size;
+        pool_mgr->total_frees++;
+    }
+
+    // merge each run of gaps into its first node, and add that to the gap
+    // index; a node merged before is unused, or in the gap index
+    // note: segments in different extents are not contiguous, so never merge
+    for (unsigned d = 0; d < n; ++d) {
+        node_pt node = nodes[d];
+        if (! node->used || node->allocated || _mem_gap_indexed(pool_mgr, node)) {
+            continue;
+        }
+
+        //   find the first gap of the run
+        while (! node->extent_start && node->prev != NULL &&
+               node->prev->used && node->prev->allocated == 0) {
+            node = node->prev;
+        }
+        if (_mem_gap_indexed(pool_mgr, node) &&
+            _mem_remove_from_gap_ix(pool_mgr, node->alloc_record.size, node) != ALLOC_OK) {
+            status = ALLOC_FAIL;
+        }
+
+        //   merge the rest of the run into it, taking the gaps that were
+        //   already there out of the gap index
+        while (node->next != NULL && node->next->used && node->next->allocated == 0 &&
+               ! node->next->extent_start) {
+            node_pt next = node->next;
+            if (_mem_gap_indexed(pool_mgr, next) &&
+                _mem_remove_from_gap_ix(pool_mgr, next->alloc_record.size, next) != ALLOC_OK) {
+                status = ALLOC_FAIL;
+            }
+            node->alloc_record.size = node->alloc_record.size + next->alloc_record.size;
+            node->next = next->next;
+            if (next->next != NULL) {
+                next->next->prev = node;
+            }
+            next->next = NULL;
+            next->prev = NULL;
+            _mem_release_node(pool_mgr, next);
+        }
+
+        //   add the merged run to the gap index
+        if (_mem_add_to_gap_ix(pool_mgr, node->alloc_record.size, node) != ALLOC_OK) {
+            status = ALLOC_FAIL;
+        }
+    }
+
+    return status;
+}
+
+// returns 1 if the gap node has an entry in the gap index
+static int _mem_gap_indexed(pool_mgr_pt pool_mgr, node_pt node) {
+    return node->gap_ix_pos < pool_mgr->pool.num_gaps &&
+           pool_mgr->gap_ix[node->gap_ix_pos].node == node;
+}
+
+// returns the quick list of an exact size, by Fibonacci hashing, so that
+// sizes that are multiples of each other still spread out
+static unsigned _mem_quick_list(size_t size) {
+    return (unsigned) (((uint64_t) size * 0x9E3779B97F4A7C15u) >> (64 - MEM_QUICK_LIST_LOG2));
+}
+
+// pops a node of exactly the size off its quick list, or returns null if
+// there is none
+// note: the node never stopped being an allocation, so the metadata
+// does not change, but the allocation is counted
+static node_pt _mem_quick_new_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned list = _mem_quick_list(size);
+    if (pool_mgr->quick_count[list] == 0 || pool_mgr->quick_size[list] != size) {
+        return NULL;
+    }
+
+    pool_mgr->quick_count[list]--;
+    pool_mgr->num_quick--;
+    pool_mgr->total_allocs++;
+    node_pt node = pool_mgr->quick_nodes[list * pool_mgr->quick_capacity + pool_mgr->quick_count[list]];
+    node->quick = 0;
+    node->align_shift = 0;
+    return node;
+}
+
+// pushes the allocation node on the quick list of its size, without
+// coalescing it; a full list is coalesced first; returns ALLOC_FAIL if
+// it is not listed, because the list holds another size
+static alloc_status _mem_quick_del_alloc(pool_mgr_pt pool_mgr, node_pt node) {
+    size_t size = node->alloc_record.size;
+    unsigned list = _mem_quick_list(size);
+    if (! node->used || ! node->allocated ||
+        (pool_mgr->quick_count[list] > 0 && pool_mgr->quick_size[list] != size)) {
+        return ALLOC_FAIL;
+    }
+
+    // coalesce the nodes of a full list back into the gap index
+    node_pt *quickNodes = pool_mgr->quick_nodes + list * pool_mgr->quick_capacity;
+    if (pool_mgr->quick_count[list] == pool_mgr->quick_capacity) {
+        unsigned count = pool_mgr->quick_count[list];
+        for (unsigned q = 0; q < count; ++q) {
+            quickNodes[q]->quick = 0;
+        }
+        pool_mgr->quick_count[list] = 0;
+        pool_mgr->num_quick -= count;
+        _mem_free_listed_nodes(pool_mgr, quickNodes, count);
+    }
+
+    quickNodes[pool_mgr->quick_count[list]] = node;
+    pool_mgr->quick_count[list]++;
+    pool_mgr->quick_size[list] = size;
+    pool_mgr->num_quick++;
+    pool_mgr->total_frees++;
+    node->quick = 1;
+    node->pinned = 0;
+    return ALLOC_OK;
+}
+
+// coalesces the nodes on all the quick lists back into the gap index, in
+// a single batch
+static alloc_status _mem_drain_quick_lists(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->num_quick == 0) {
+        return ALLOC_OK;
+    }
+
+    // gather the nodes at the front of the lists, unmarked
+    unsigned numQuick = 0;
+    for (unsigned l = 0; l < MEM_QUICK_LIST_COUNT; ++l) {
+        for (unsigned q = 0; q < pool_mgr->quick_count[l]; ++q) {
+            node_pt node = pool_mgr->quick_nodes[l * pool_mgr->quick_capacity + q];
+            node->quick = 0;
+            pool_mgr->quick_nodes[numQuick] = node;
+            numQuick++;
+        }
+        pool_mgr->quick_count[l] = 0;
+    }
+    pool_mgr->num_quick = 0;
+
+    return _mem_free_listed_nodes(pool_mgr, pool_mgr->quick_nodes, numQuick);
+}
+
+// coalesces the nodes as _mem_free_nodes() does, but without counting
+// them as deallocations, as they were counted as they went on a quick
+// list or into a thread cache
+static alloc_status _mem_free_listed_nodes(pool_mgr_pt pool_mgr, node_pt *nodes, unsigned n) {
+    size_t totalFrees = pool_mgr->total_frees;
+    alloc_status status = _mem_free_nodes(pool_mgr, nodes, n);
+    pool_mgr->total_frees = totalFrees;
+    return status;
+}
+
+// only the pools with a node list of arbitrary segments can slide their
+// allocations, and a sharded pool would move the memory it lent
+static int _mem_compactable(pool_mgr_pt pool_mgr) {
+    return pool_mgr != NULL && pool_mgr->num_shards == 0 &&
+           (pool_mgr->pool.policy == FIRST_FIT || pool_mgr->pool.policy == BEST_FIT ||
+            pool_mgr->pool.policy == SEGREGATED_FIT || pool_mgr->pool.policy == TLSF);
+}
+
+// slides the allocations down into the gaps before them, from the cursor
+// on, until about the budget of bytes is spent, or the end of the pool is
+// reached; returns ALLOC_PARTIAL in the first case, and starts the next
+// call where it stopped
+// note: the bytes moved and a node for each segment passed count against
+// the budget, so a step over many segments that do not move is bounded too
+// note: a pinned allocation stays, and the gap before it with it, and
+// the segments of different extents are not contiguous, so the gap at the
+// end of an extent stays as well
+static alloc_status _mem_compact(pool_mgr_pt pool_mgr, size_t budget) {
+    size_t spent = 0;
+    node_pt node = _mem_compact_resume(pool_mgr);
+    while (node != NULL) {
+        //   stop at the segment, if the budget is spent
+        if (budget > 0 && spent >= budget) {
+            pool_mgr->compact_cursor = node->alloc_record.mem;
+            return ALLOC_PARTIAL;
+        }
+        spent += sizeof(node_t);
+
+        node_pt next = node->next;
+        if (node->allocated || next == NULL || ! next->allocated ||
+            next->extent_start || next->pinned) {
+            node = next;
+            continue;
+        }
+
+        //   the gap moves up past the allocation, so it is tried again
+        spent += next->alloc_record.size;
+        if (_mem_compact_slide(pool_mgr, node) != ALLOC_OK) {
+            pool_mgr->compact_cursor = NULL;
+            return ALLOC_FAIL;
+        }
+    }
+
+    pool_mgr->compact_cursor = NULL;
+    return ALLOC_OK;
+}
+
+// returns the node to resume compaction at: the segment that holds the
+// cursor, found from the segment that holds the start of its granule or
+// page, as in the page map, or from the start of its extent if the
+// entries are stale, or the start of the pool
+// note: the step starts at the cursor, not before it, so that even a step
+// of a budget too small to move anything gets further than the last one
+static node_pt _mem_compact_resume(pool_mgr_pt pool_mgr) {
+    char *cursor = pool_mgr->compact_cursor;
+    extent_pt extent = (cursor != NULL) ? _mem_find_extent(pool_mgr, cursor) : NULL;
+    if (extent == NULL) {
+        return pool_mgr->node_heap;
+    }
+
+    node_pt node = _mem_page_map_start(extent, cursor);
+    if (node == NULL) {
+        node = extent->first;
+    }
+    while (node->next != NULL && ! node->next->extent_start &&
+           node->next->alloc_record.mem <= cursor) {
+        node = node->next;
+    }
+    return node;
+}
+
+// moves the data of the allocation after the gap down to the start of the
+// gap, and swaps the two nodes, so the gap follows the allocation and
+// merges with the gap after it, if any
+// note: the allocation keeps its node, so its handle stays valid, and
+// only alloc_record.mem changes
+static alloc_status _mem_compact_slide(pool_mgr_pt pool_mgr, node_pt gap) {
+    node_pt alloc = gap->next;
+    if (_mem_remove_from_gap_ix(pool_mgr, gap->alloc_record.size, gap) != ALLOC_OK) {
+        return ALLOC_FAIL;
+    }
+
+    // move the data down, over the gap and maybe over itself
+    char *mem = gap->alloc_record.mem;
+    memmove(mem, alloc->alloc_record.mem, alloc->alloc_record.size);
+    alloc->alloc_record.mem = mem;
+    gap->alloc_record.mem = mem + alloc->alloc_record.size;
+
+    // swap the nodes in the list
+    alloc->prev = gap->prev;
+    if (gap->prev != NULL) {
+        gap->prev->next = alloc;
+    }
+    gap->next = alloc->next;
+    if (alloc->next != NULL) {
+        alloc->next->prev = gap;
+    }
+    alloc->next = gap;
+    gap->prev = alloc;
+
+    // the allocation may start its extent, and the pool, now
+    if (gap->extent_start) {
+        _mem_find_extent(pool_mgr, mem)->first = alloc;
+        alloc->extent_start = 1;
+        gap->extent_start = 0;
+        if (pool_mgr->node_heap == gap) {
+            pool_mgr->node_heap = alloc;
+        }
+    }
+
+    // merge the gap after into the gap, and release its node
+    node_pt next = gap->next;
+    if (next != NULL && next->used && ! next->allocated && ! next->extent_start) {
+        if (_mem_remove_from_gap_ix(pool_mgr, next->alloc_record.size, next) != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+        gap->alloc_record.size = gap->alloc_record.size + next->alloc_record.size;
+        gap->next = next->next;
+        if (next->next != NULL) {
+            next->next->prev = gap;
+        }
+        next->next = NULL;
+        next->prev = NULL;
+        _mem_release_node(pool_mgr, next);
+    }
+
+    _mem_page_map_set(pool_mgr, alloc);
+    _mem_page_map_set(pool_mgr, gap);
+    return _mem_add_to_gap_ix(pool_mgr, gap->alloc_record.size, gap);
+}
+
+// runs a compaction step as memory is freed, if the pool is set to, and
+// the share of its free memory outside the largest gap is over the
+// threshold; the deferred frees and the quick lists are coalesced first,
+// as by mem_pool_compact, so they are not moved
+// note: the step is capped, so a budget of 0 does not compact the whole
+// pool inside a deallocation
+static void _mem_auto_compact(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->compact_threshold <= 0) {
+        return;
+    }
+    size_t freeSize = pool_mgr->pool.total_size - pool_mgr->pool.alloc_size;
+    if (_mem_fragmentation(freeSize, _mem_largest_gap(pool_mgr)) <= pool_mgr->compact_threshold) {
+        return;
+    }
+    if (_mem_drain_deferred_frees(pool_mgr) != ALLOC_OK ||
+        _mem_drain_quick_lists(pool_mgr) != ALLOC_OK) {
+        return;
+    }
+    size_t budget = pool_mgr->compact_budget;
+    if (budget == 0 || budget > MEM_COMPACT_AUTO_BUDGET) {
+        budget = MEM_COMPACT_AUTO_BUDGET;
+    }
+    _mem_compact(pool_mgr, budget);
+}
+
+// returns the size of the largest gap, as kept by the gap index and the
+// free lists; a SLAB gap is a free slot, and the ARENA gap is the rest of
+// the pool
+// note: only after the last gap of the largest size is taken, and nothing
+// as large is added, does it have to be found again
+static size_t _mem_largest_gap(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->pool.num_gaps == 0) {
+        return 0;
+    }
+
+    if (pool_mgr->pool.policy == SLAB) {
+        return pool_mgr->slab_slot_size;
+    }
+
+    if (pool_mgr->pool.policy == ARENA) {
+        return pool_mgr->pool.total_size - pool_mgr->arena_top;
+    }
+
+    if (! pool_mgr->largest_gap_exact) {
+        pool_mgr->largest_gap = _mem_find_largest_gap(pool_mgr, &pool_mgr->largest_gap_count);
+        pool_mgr->largest_gap_exact = 1;
+    }
+    return pool_mgr->largest_gap;
+}
+
+// finds the size of the largest gap, and how many gaps have it, or fewer:
+// the root of the address tree holds it for FIRST_FIT, in O(1), and the
+// rightmost entry of the size tree is it for BEST_FIT, in O(log n), for
+// which the count is 1; the size class policies search the highest
+// non-empty list, in one step per gap on it, and count them all
+static size_t _mem_find_largest_gap(pool_mgr_pt pool_mgr, unsigned *count) {
+    size_t largestGap = 0;
+    *count = 1;
+    if (pool_mgr->pool.policy == BOUNDARY_TAG) {
+        char *block = pool_mgr->tag_class_head[_mem_highest_bit(pool_mgr->gap_class_map)];
+        while (block != NULL) {
+            if (_mem_tag_size(block) > largestGap) {
+                largestGap = _mem_tag_size(block);
+                *count = 1;
+            } else if (_mem_tag_size(block) == largestGap) {
+                (*count)++;
+            }
+            block = _mem_tag_links(block)[1];
+        }
+        return largestGap;
+    }
+
+    if (pool_mgr->pool.policy == FIRST_FIT) {
+        return pool_mgr->gap_ix[pool_mgr->gap_ix_root[GAP_TREE_ADDR]].max_size;
+    }
+
+    if (pool_mgr->pool.policy == BEST_FIT) {
+        unsigned current = pool_mgr->gap_ix_root[GAP_TREE_SIZE];
+        while (pool_mgr->gap_ix[current].link[GAP_TREE_SIZE].right != MEM_GAP_IX_NIL) {
+            current = pool_mgr->gap_ix[current].link[GAP_TREE_SIZE].right;
+        }
+        return pool_mgr->gap_ix[current].size;
+    }
+
+    if (pool_mgr->gap_class_map == 0) {
+        *count = 0;
+        return 0;
+    }
+    unsigned fl = _mem_highest_bit(pool_mgr->gap_class_map);
+    unsigned sl = _mem_highest_bit(pool_mgr->gap_subclass_map[fl]);
+    unsigned current = pool_mgr->gap_class_head[fl * MEM_GAP_SUBCLASS_COUNT + sl];
+    while (current != MEM_GAP_IX_NIL) {
+        if (pool_mgr->gap_ix[current].size > largestGap) {
+            largestGap = pool_mgr->gap_ix[current].size;
+            *count = 1;
+        } else if (pool_mgr->gap_ix[current].size == largestGap) {
+            (*count)++;
+        }
+        current = pool_mgr->gap_ix[current].class_next;
+    }
+    return largestGap;
+}
+
+// keeps the largest gap as a gap is added: one at least as large is the
+// largest now, as no other gap is larger than the last largest, and one
+// as large is counted with the others of its size
+static void _mem_largest_gap_add(pool_mgr_pt pool_mgr, size_t size) {
+    if (size == pool_mgr->largest_gap && pool_mgr->largest_gap_exact) {
+        pool_mgr->largest_gap_count++;
+    } else if (size >= pool_mgr->largest_gap) {
+        pool_mgr->largest_gap = size;
+        pool_mgr->largest_gap_exact = 1;
+        pool_mgr->largest_gap_count = 1;
+    }
+}
+
+// keeps the largest gap as a gap is removed: if it was the last of the
+// largest size, the rest are smaller, but the largest of them has to be
+// found again
+static void _mem_largest_gap_remove(pool_mgr_pt pool_mgr, size_t size) {
+    if (size == pool_mgr->largest_gap && pool_mgr->largest_gap_exact) {
+        pool_mgr->largest_gap_count--;
+        if (pool_mgr->largest_gap_count == 0) {
+            pool_mgr->largest_gap_exact = 0;
+        }
+    }
+}
+
+// returns the share of the free memory outside the largest gap, which
+// is 0 when the free memory is in a single gap, or there is none
+static float _mem_fragmentation(size_t free_size, size_t largest_gap) {
+    if (free_size <= largest_gap) {
+        return 0;
+    }
+    return (float) (free_size - largest_gap) / (float) free_size;
+}
+
+// fills in the stats of the pool, from the counts it keeps as it goes;
+// only the largest gap is looked up, as above
+// note: SLAB and ARENA pools keep no gap histogram, as the free slots,
+// and the rest of the pool, are their gaps; any free slot fits any
+// allocation, so a SLAB pool is never fragmented
+static void _mem_stats(pool_mgr_pt pool_mgr, pool_stats_pt stats) {
+    size_t freeSize = pool_mgr->pool.total_size - pool_mgr->pool.alloc_size;
+    stats->largest_gap = _mem_largest_gap(pool_mgr);
+    stats->fragmentation = _mem_fragmentation(freeSize, stats->largest_gap);
+    memcpy(stats->gap_histogram, pool_mgr->gap_histogram, sizeof(stats->gap_histogram));
+    if (pool_mgr->pool.policy == SLAB || pool_mgr->pool.policy == ARENA) {
+        memset(stats->gap_histogram, 0, sizeof(stats->gap_histogram));
+        if (stats->largest_gap > 0) {
+            stats->gap_histogram[_mem_size_class(stats->largest_gap)] =
+                    (pool_mgr->pool.policy == SLAB) ?
+                    pool_mgr->slab_count - pool_mgr->pool.num_allocs : 1;
+        }
+    }
+    if (pool_mgr->pool.policy == SLAB) {
+        stats->fragmentation = 0;
+    }
+    stats->peak_alloc_size = pool_mgr->peak_alloc_size;
+    stats->peak_used_nodes = pool_mgr->peak_used_nodes;
+    stats->total_allocs = pool_mgr->total_allocs;
+    stats->total_frees = pool_mgr->total_frees;
+    stats->total_failures = pool_mgr->total_failures;
+    stats->remote_failures = pool_mgr->remote_failures;
+
+    // the blocks held on the quick lists, and in the thread caches, with
+    // the allocations and deallocations the caches took, as their owners
+    // last counted them
+    stats->cached_blocks = pool_mgr->num_quick;
+    stats->cached_size = 0;
+    for (unsigned l = 0; l < MEM_QUICK_LIST_COUNT; ++l) {
+        stats->cached_size += pool_mgr->quick_size[l] * pool_mgr->quick_count[l];
+    }
+    for (unsigned t = 0; pool_mgr->thread_caches != NULL && t < MEM_THREAD_CACHE_MAX_THREADS; ++t) {
+        thread_cache_pt cache = pool_mgr->thread_caches[t];
+        if (cache != NULL) {
+            stats->total_allocs += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+            stats->total_frees += atomic_load_explicit(&cache->frees, memory_order_relaxed);
+            stats->cached_blocks += (unsigned) atomic_load_explicit(&cache->held, memory_order_relaxed);
+            stats->cached_size += atomic_load_explicit(&cache->held_size, memory_order_relaxed);
+        }
+    }
+}
+
+// returns the number of blocks held on the quick lists and in the thread
+// caches, which are allocations of the pool, but not in use
+static unsigned _mem_cached_blocks(pool_mgr_pt pool_mgr) {
+    unsigned cachedBlocks = pool_mgr->num_quick;
+    for (unsigned t = 0; pool_mgr->thread_caches != NULL && t < MEM_THREAD_CACHE_MAX_THREADS; ++t) {
+        thread_cache_pt cache = pool_mgr->thread_caches[t];
+        if (cache != NULL) {
+            cachedBlocks += (unsigned) atomic_load_explicit(&cache->held, memory_order_relaxed);
+        }
+    }
+    return cachedBlocks;
+}
+
+// raises the high-water mark of alloc_size, as it grows
+static void _mem_stats_peak(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->pool.alloc_size > pool_mgr->peak_alloc_size) {
+        pool_mgr->peak_alloc_size = pool_mgr->pool.alloc_size;
+    }
+}
+
+// pins or unpins the allocation, given either its handle or its data
+// pointer, as in mem_del_alloc
+static alloc_status _mem_set_pinned(pool_mgr_pt pool_mgr, void *alloc, unsigned pinned) {
+    node_pt node = _mem_alloc_node(pool_mgr, alloc);
+    if (node == NULL || (node != alloc && node->alloc_record.mem != alloc) ||
+        ! node->used || ! node->allocated || node->quick || node->cached) {
+        return ALLOC_FAIL;
+    }
+    node->pinned = pinned;
+    return ALLOC_OK;
+}
+
+// returns the index of the calling thread in the thread caches of the
+// pools, or MEM_THREAD_CACHE_MAX_THREADS if it cannot have a cache
+// note: the index of a thread that exits goes to the next new thread,
+// along with whatever is left in its caches; without thread safety, there
+// is only the one cache
+static unsigned _mem_thread_ix() {
+#ifdef MEM_POOL_THREAD_SAFE
+    if (thread_ix == 0) {
+        pthread_once(&thread_ix_once, _mem_thread_ix_init);
+
+        // take the lowest free index, if any
+        _mem_store_lock();
+        unsigned ix = MEM_THREAD_CACHE_MAX_THREADS;
+        if (~thread_ix_map != 0) {
+            ix = _mem_lowest_bit(~thread_ix_map);
+            thread_ix_map |= (uint64_t) 1 << ix;
+        }
+        _mem_store_unlock();
+
+        // note: the key only keeps a real index, to give it up on exit
+        thread_ix = ix + 1;
+        if (ix < MEM_THREAD_CACHE_MAX_THREADS) {
+            pthread_setspecific(thread_ix_key, (void *) (uintptr_t) thread_ix);
+        }
+    }
+    return thread_ix - 1;
+#else
+    return 0;
+#endif
+}
+
+#ifdef MEM_POOL_THREAD_SAFE
+static void _mem_thread_ix_init() {
+    pthread_key_create(&thread_ix_key, _mem_thread_ix_release);
+}
+
+static void _mem_thread_ix_release(void *ix) {
+    _mem_store_lock();
+    thread_ix_map &= ~((uint64_t) 1 << ((uintptr_t) ix - 1));
+    _mem_store_unlock();
+}
+#endif
+
+// returns the cache of the calling thread, made on first use, or null
+static thread_cache_pt _mem_thread_cache(pool_mgr_pt pool_mgr) {
+    unsigned ix = _mem_thread_ix();
+    if (ix >= MEM_THREAD_CACHE_MAX_THREADS) {
+        return NULL;
+    }
+    thread_cache_pt cache = pool_mgr->thread_caches[ix];
+    if (cache != NULL) {
+        return cache;
+    }
+
+    // note: only this thread makes its cache, but the pool lock keeps
+    // mem_pool_thread_cache_stats from reading it halfway
+    cache = calloc(1, sizeof(thread_cache_t));
+    void **blocks = malloc(sizeof(void *) * MEM_THREAD_CACHE_CLASS_COUNT * pool_mgr->cache_capacity);
+    if (cache == NULL || blocks == NULL) {
+        free(blocks);
+        free(cache);
+        return NULL;
+    }
+    cache->blocks = blocks;
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->frees, 0);
+    atomic_init(&cache->held, 0);
+    atomic_init(&cache->held_size, 0);
+
+    _mem_pool_lock_read(pool_mgr);
+    pool_mgr->thread_caches[ix] = cache;
+    _mem_pool_unlock(pool_mgr);
+
+    return cache;
+}
+
+// allocates from the thread cache: pops a block of the size class, or
+// else allocates a batch of them under a single lock; the blocks are
+// allocated with the full size of their class, so any one fits
+static void * _mem_cache_new_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned sizeClass = (unsigned) ((size - 1) / MEM_THREAD_CACHE_CLASS_SIZE);
+    size_t classSize = (sizeClass + 1) * MEM_THREAD_CACHE_CLASS_SIZE;
+    unsigned capacity = pool_mgr->cache_capacity;
+
+    // buddy blocks are a power of two, so they are cached in those classes
+    if (pool_mgr->pool.policy == BUDDY) {
+        size_t blockSize = MEM_BUDDY_MIN_BLOCK;
+        while (blockSize < classSize) {
+            blockSize <<= 1;
+        }
+        classSize = blockSize;
+        sizeClass = (unsigned) (classSize / MEM_THREAD_CACHE_CLASS_SIZE - 1);
+    }
+
+    thread_cache_pt cache = _mem_thread_cache(pool_mgr);
+    if (cache != NULL && cache->count[sizeClass] > 0) {
+        _mem_count(&cache->hits);
+        cache->count[sizeClass]--;
+        node_pt node = cache->blocks[sizeClass * capacity + cache->count[sizeClass]];
+        node->cached = 0;
+        node->align_shift = 0;
+        _mem_count_add(&cache->held, 0 - (size_t) 1);
+        _mem_count_add(&cache->held_size, 0 - node->alloc_record.size);
+        return node;
+    }
+
+    // refill with half the capacity, one of which is handed out
+    // note: only that one is counted as an allocation, the rest are when
+    // they are handed out, as hits
+    unsigned batch = (cache != NULL && capacity > 1) ? capacity / 2 : 1;
+    _mem_pool_lock(pool_mgr);
+    void *alloc = _mem_new_alloc((pool_pt) pool_mgr, classSize, 1);
+    for (unsigned i = 1; i < batch && alloc != NULL; ++i) {
+        void *block = _mem_new_alloc((pool_pt) pool_mgr, classSize, 1);
+        if (block == NULL) {
+            break;
+        }
+        pool_mgr->total_allocs--;
+        cache->blocks[sizeClass * capacity + cache->count[sizeClass]] = block;
+        cache->count[sizeClass]++;
+        _mem_count_add(&cache->held, 1);
+        _mem_count_add(&cache->held_size, ((node_pt) block)->alloc_record.size);
+    }
+    if (alloc == NULL) {
+        pool_mgr->total_failures++;
+    }
+    _mem_pool_unlock(pool_mgr);
+
+    if (cache != NULL) {
+        _mem_count(&cache->misses);
+    }
+    return alloc;
+}
+
+// deallocates into the thread cache, if the allocation is a handle of a
+// size that is exactly that of a size class; the older half of a full
+// class is flushed under a single lock first; returns ALLOC_FAIL if it
+// is not cached
+static alloc_status _mem_cache_del_alloc(pool_mgr_pt pool_mgr, void *alloc) {
+    // only a node of this pool is read; anything else, a data pointer
+    // included, is left to the locked path
+    node_pt node = _mem_chunk_ix_find(pool_mgr, alloc);
+    if (node == NULL) {
+        return ALLOC_FAIL;
+    }
+
+    // note: an allocation is not changed by other threads, so its node
+    // can be read without the lock
+    // note: a node that is cached or on a quick list is freed already
+    size_t size = node->alloc_record.size;
+    if (! node->used || ! node->allocated || node->cached || node->quick || size == 0 ||
+        size % MEM_THREAD_CACHE_CLASS_SIZE != 0 ||
+        size > MEM_THREAD_CACHE_CLASS_SIZE * MEM_THREAD_CACHE_CLASS_COUNT) {
+        return ALLOC_FAIL;
+    }
+    thread_cache_pt cache = _mem_thread_cache(pool_mgr);
+    if (cache == NULL) {
+        return ALLOC_FAIL;
+    }
+
+    unsigned sizeClass = (unsigned) (size / MEM_THREAD_CACHE_CLASS_SIZE - 1);
+    unsigned capacity = pool_mgr->cache_capacity;
+    void **blocks = &cache->blocks[sizeClass * capacity];
+    if (cache->count[sizeClass] == capacity) {
+        // note: the flushed blocks were counted as deallocations as they
+        // went into the cache
+        unsigned flush = (capacity + 1) / 2;
+        _mem_pool_lock(pool_mgr);
+        size_t totalFrees = pool_mgr->total_frees;
+        for (unsigned i = 0; i < flush; ++i) {
+            ((node_pt) blocks[i])->cached = 0;
+            _mem_del_alloc((pool_pt) pool_mgr, blocks[i]);
+        }
+        pool_mgr->total_frees = totalFrees;
+        _mem_pool_unlock(pool_mgr);
+        _mem_count_add(&cache->held, 0 - (size_t) flush);
+        _mem_count_add(&cache->held_size, 0 - size * flush);
+        memmove(blocks, blocks + flush, sizeof(void *) * (capacity - flush));
+        cache->count[sizeClass] = capacity - flush;
+    }
+    node->cached = 1;
+    blocks[cache->count[sizeClass]] = alloc;
+    cache->count[sizeClass]++;
+    _mem_count(&cache->frees);
+    _mem_count_add(&cache->held, 1);
+    _mem_count_add(&cache->held_size, size);
+
+    return ALLOC_OK;
+}
+
+// gives all the blocks in the thread caches back to the pool, without
+// counting them as deallocations again
+// note: the caller makes sure no other thread uses the pool
+static void _mem_flush_thread_caches(pool_mgr_pt pool_mgr) {
+    size_t totalFrees = pool_mgr->total_frees;
+    for (unsigned t = 0; pool_mgr->thread_caches != NULL && t < MEM_THREAD_CACHE_MAX_THREADS; ++t) {
+        thread_cache_pt cache = pool_mgr->thread_caches[t];
+        for (unsigned c = 0; cache != NULL && c < MEM_THREAD_CACHE_CLASS_COUNT; ++c) {
+            for (unsigned i = 0; i < cache->count[c]; ++i) {
+                node_pt node = cache->blocks[c * pool_mgr->cache_capacity + i];
+                node->cached = 0;
+                _mem_del_alloc((pool_pt) pool_mgr, node);
+            }
+            cache->count[c] = 0;
+        }
+        if (cache != NULL) {
+            _mem_count_reset(cache);
+        }
+    }
+    pool_mgr->total_frees = totalFrees;
+}
+
+// frees the (flushed) thread caches, keeping their counts
+static void _mem_free_thread_caches(pool_mgr_pt pool_mgr) {
+    for (unsigned t = 0; pool_mgr->thread_caches != NULL && t < MEM_THREAD_CACHE_MAX_THREADS; ++t) {
+        thread_cache_pt cache = pool_mgr->thread_caches[t];
+        if (cache != NULL) {
+            pool_mgr->cache_hits += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+            pool_mgr->cache_misses += atomic_load_explicit(&cache->misses, memory_order_relaxed);
+            pool_mgr->total_allocs += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+            pool_mgr->total_frees += atomic_load_explicit(&cache->frees, memory_order_relaxed);
+            free(cache->blocks);
+            free(cache);
+        }
+    }
+    free(pool_mgr->thread_caches);
+    pool_mgr->thread_caches = NULL;
+    pool_mgr->cache_capacity = 0;
+}
+
+// counts an event of the owning thread: only it writes, so no atomic
+// read-modify-write is needed, just a load and a store
+static void _mem_count(atomic_size_t *counter) {
+    _mem_count_add(counter, 1);
+}
+
+// adds to a count of the owning thread, as above; a count goes down by
+// adding the negated amount, which wraps around as size_t does
+static void _mem_count_add(atomic_size_t *counter, size_t delta) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + delta,
+                          memory_order_relaxed);
+}
+
+// empties the counts of the blocks in a cache, as they go back to the pool
+// note: the caller makes sure the owning thread does not use the cache
+static void _mem_count_reset(thread_cache_pt cache) {
+    atomic_store_explicit(&cache->held, 0, memory_order_relaxed);
+    atomic_store_explicit(&cache->held_size, 0, memory_order_relaxed);
+}
+
+// allocates from the shard of the calling thread, or else borrows a gap
+// from another shard for it
+// note: shards go by the thread index, which stays the same for a
+// thread, rather than by the CPU it happens to run on
+static void * _mem_shard_new_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    unsigned shard = _mem_thread_ix() % pool_mgr->num_shards;
+    void *alloc = mem_new_alloc_aligned((pool_pt) pool_mgr->shards[shard], size, alignment);
+    if (alloc == NULL && alignment != 0 && (alignment & (alignment - 1)) == 0) {
+        alloc = _mem_shard_steal(pool_mgr, shard, size, alignment);
+    }
+
+    // the pool counts its own failures, as a shard that fails may borrow
+    if (alloc == NULL) {
+        _mem_pool_lock(pool_mgr);
+        pool_mgr->total_failures++;
+        _mem_pool_unlock(pool_mgr);
+    }
+    return alloc;
+}
+
+// borrows a gap for the allocation from one of the other shards, in turn:
+// the lender allocates half a shard, or less down to the size, and the
+// borrower takes the allocation in as an extent, and allocates from it;
+// returns the allocation, or null if no shard has a gap that fits
+// note: the sharded pool is locked only to take a slot for the loan, so
+// steals into different shards go on side by side
+static void * _mem_shard_steal(pool_mgr_pt pool_mgr, unsigned shard, size_t size, size_t alignment) {
+    size_t classSize = size + (alignment - 1);
+    if (classSize < size) {
+        return NULL;
+    }
+
+    void *alloc = NULL;
+    unsigned full = 0;
+    pool_mgr_pt borrower = pool_mgr->shards[shard];
+    for (unsigned s = 1; alloc == NULL && ! full && s < pool_mgr->num_shards; ++s) {
+        // ask the lender for as large a gap as it has, within half a shard
+        unsigned lender = (shard + s) % pool_mgr->num_shards;
+        pool_mgr_pt lenderMgr = pool_mgr->shards[lender];
+        size_t loanSize = pool_mgr->shard_size / 2;
+        alloc_pt loan;
+        _mem_pool_lock(lenderMgr);
+        _mem_drain_remote_frees(lenderMgr);
+        for (;;) {
+            if (loanSize < classSize) {
+                loanSize = classSize;
+            }
+            loan = _mem_new_alloc((pool_pt) lenderMgr, loanSize, 1);
+            if (loan != NULL || loanSize == classSize) {
+                break;
+            }
+            loanSize /= 2;
+        }
+        _mem_pool_unlock(lenderMgr);
+        if (loan == NULL) {
+            continue;
+        }
+
+        // the loan is published before the lock is let go, so it is found
+        // for whatever is allocated in it
+        _mem_pool_lock(borrower);
+        node_pt node = _mem_add_extent(borrower, loan->size, loan->mem);
+        if (node != NULL) {
+            _mem_pool_lock(pool_mgr);
+            full = (_mem_shard_lend(pool_mgr, loan, lender, shard) != ALLOC_OK);
+            _mem_pool_unlock(pool_mgr);
+            if (! full) {
+                alloc = _mem_new_alloc((pool_pt) borrower, size, alignment);
+            } else if (_mem_remove_extent(borrower,
+                                          &borrower->extents[borrower->num_extents - 1]) == ALLOC_OK) {
+                node = NULL;
+            }
+        }
+        _mem_pool_unlock(borrower);
+
+        // give the loan back, if the borrower could not take it in
+        if (node == NULL) {
+            _mem_pool_lock(lenderMgr);
+            _mem_drain_remote_frees(lenderMgr);
+            _mem_del_alloc((pool_pt) lenderMgr, loan);
+            _mem_pool_unlock(lenderMgr);
+        }
+    }
+
+    return alloc;
+}
+
+// takes a free slot for the loan and publishes it, under the lock of the
+// sharded pool; the loan no longer counts as an allocation of the pool;
+// returns ALLOC_FAIL if all MEM_SHARD_MAX_LOANS slots are lent
+static alloc_status _mem_shard_lend(pool_mgr_pt pool_mgr, alloc_pt loan, unsigned lender, unsigned borrower) {
+    unsigned numLoans = atomic_load_explicit(&pool_mgr->num_loans, memory_order_relaxed);
+    unsigned l = 0;
+    while (l < numLoans && atomic_load_explicit(&pool_mgr->loans[l].seq, memory_order_relaxed) % 2 != 0) {
+        ++l;
+    }
+    if (l == MEM_SHARD_MAX_LOANS) {
+        return ALLOC_FAIL;
+    }
+
+    // a loan lent out of a borrowed extent lies inside the loan of it
+    unsigned slice = _mem_shard_slice(pool_mgr, loan->mem);
+    shard_loan_t outer;
+    unsigned outerSeq;
+    unsigned depth = (_mem_shard_loan_of(pool_mgr, slice, loan->mem, &outer, &outerSeq) !=
+                      MEM_SHARD_MAX_LOANS) ? outer.depth + 1 : 1;
+
+    // note: the fence keeps the writes from showing before the slot was
+    // given back, as in _mem_pool_lock()
+    shard_loan_pt entry = &pool_mgr->loans[l];
+    unsigned seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry->mem = loan->mem;
+    entry->size = loan->size;
+    entry->alloc = loan;
+    entry->lender = lender;
+    entry->borrower = borrower;
+    entry->depth = depth;
+    atomic_fetch_add_explicit(&pool_mgr->slice_loans[slice], 1, memory_order_relaxed);
+    if (l == numLoans) {
+        atomic_store_explicit(&pool_mgr->num_loans, numLoans + 1, memory_order_release);
+    }
+    atomic_store_explicit(&entry->seq, seq + 1, memory_order_release);
+
+    // update metadata (alloc_size, num_allocs)
+    pool_mgr->pool.alloc_size -= loan->size;
+    pool_mgr->pool.num_allocs--;
+
+    return ALLOC_OK;
+}
+
+// deallocates in the shard that owns the allocation, and then gives back
+// the loans that it was the last allocation in
+static alloc_status _mem_shard_del_alloc(pool_mgr_pt pool_mgr, void *alloc) {
+    pool_mgr_pt shard = _mem_shard_of(pool_mgr, alloc);
+    if (shard == NULL) {
+        return ALLOC_FAIL;
+    }
+    const char *mem = (_mem_shard_slice(pool_mgr, alloc) < pool_mgr->num_shards) ?
+                      (const char *) alloc : ((alloc_pt) alloc)->mem;
+    alloc_status status = mem_del_alloc((pool_pt) shard, alloc);
+    if (status == ALLOC_OK) {
+        _mem_shard_settle(pool_mgr, mem);
+    }
+    return status;
+}
+
+// gives back the loans that hold the memory, from the innermost out, for
+// as long as they are a single gap again
+// note: a deallocation queued for another thread leaves its loan lent,
+// until a later one in it, or mem_pool_maintain()
+static void _mem_shard_settle(pool_mgr_pt pool_mgr, const char *mem) {
+    unsigned slice = _mem_shard_slice(pool_mgr, mem);
+    if (slice == pool_mgr->num_shards) {
+        return;
+    }
+    shard_loan_t loan;
+    unsigned seq;
+    for (;;) {
+        unsigned l = _mem_shard_loan_of(pool_mgr, slice, mem, &loan, &seq);
+        if (l == MEM_SHARD_MAX_LOANS || _mem_shard_return(pool_mgr, l, seq, &loan) != ALLOC_OK) {
+            return;
+        }
+    }
+}
+
+// gives back every loan that is a single gap again
+static void _mem_shard_settle_all(pool_mgr_pt pool_mgr) {
+    unsigned numLoans = atomic_load_explicit(&pool_mgr->num_loans, memory_order_acquire);
+    for (unsigned l = 0; l < numLoans; ++l) {
+        shard_loan_t loan;
+        if (_mem_shard_loan_read(pool_mgr, l, &loan) != 0) {
+            _mem_shard_settle(pool_mgr, loan.mem);
+        }
+    }
+}
+
+// gives the loan in the slot back, if it is still the one that was read
+// and its extent in the borrower is a single gap again: the borrower lets
+// go of the extent, and the lender deallocates the loan; returns
+// ALLOC_FAIL if the loan stays lent
+// note: the locks are taken shard first, as everywhere else, and the
+// sharded pool is held only while the slot and the extent go
+static alloc_status _mem_shard_return(pool_mgr_pt pool_mgr, unsigned l, unsigned seq, shard_loan_pt loan) {
+    pool_mgr_pt borrower = pool_mgr->shards[loan->borrower];
+    _mem_pool_lock(borrower);
+    _mem_drain_remote_frees(borrower);
+
+    // find the borrowed extent of the loan, and check that it is one gap
+    // note: were another extent to lie in it, it would not be one gap
+    extent_pt extent = _mem_find_extent(borrower, loan->mem);
+    alloc_status status = (extent != NULL && extent->borrowed &&
+                           extent->mem == loan->mem && extent->size == loan->size &&
+                           ! extent->first->allocated &&
+                           extent->first->alloc_record.size == extent->size) ? ALLOC_OK : ALLOC_FAIL;
+
+    _mem_pool_lock(pool_mgr);
+    shard_loan_pt entry = &pool_mgr->loans[l];
+    if (status == ALLOC_OK && atomic_load_explicit(&entry->seq, memory_order_relaxed) == seq) {
+        status = _mem_remove_extent(borrower, extent);
+    } else {
+        status = ALLOC_FAIL;
+    }
+    if (status == ALLOC_OK) {
+        atomic_store_explicit(&entry->seq, seq + 1, memory_order_release);
+        atomic_fetch_sub_explicit(&pool_mgr->slice_loans[_mem_shard_slice(pool_mgr, loan->mem)], 1,
+                                  memory_order_relaxed);
+
+        // update metadata (alloc_size, num_allocs): the loan counts as an
+        // allocation again, until the lender deallocates it
+        pool_mgr->pool.alloc_size += loan->size;
+        pool_mgr->pool.num_allocs++;
+    }
+    _mem_pool_unlock(pool_mgr);
+    _mem_pool_unlock(borrower);
+    if (status != ALLOC_OK) {
+        return ALLOC_FAIL;
+    }
+
+    pool_mgr_pt lender = pool_mgr->shards[loan->lender];
+    _mem_pool_lock(lender);
+    _mem_drain_remote_frees(lender);
+    _mem_del_alloc((pool_pt) lender, loan->alloc);
+    _mem_pool_unlock(lender);
+
+    return ALLOC_OK;
+}
+
+// hands the changes in the counts of the shard since it last did on to its
+// sharded pool, under the lock of the shard, so the pool is always current
+// note: most calls change nothing the pool shows, and take no lock of it
+static void _mem_shard_report(pool_mgr_pt shard) {
+    if (shard->pool.alloc_size == shard->reported_alloc_size &&
+        shard->pool.num_allocs == shard->reported_num_allocs &&
+        shard->pool.num_gaps == shard->reported_num_gaps) {
+        return;
+    }
+
+    pool_mgr_pt parent = shard->parent;
+    _mem_pool_lock(parent);
+    parent->pool.alloc_size = parent->pool.alloc_size + shard->pool.alloc_size - shard->reported_alloc_size;
+    parent->pool.num_allocs = parent->pool.num_allocs + shard->pool.num_allocs - shard->reported_num_allocs;
+    parent->pool.num_gaps = parent->pool.num_gaps + shard->pool.num_gaps - shard->reported_num_gaps;
+    _mem_pool_unlock(parent);
+
+    shard->reported_alloc_size = shard->pool.alloc_size;
+    shard->reported_num_allocs = shard->pool.num_allocs;
+    shard->reported_num_gaps = shard->pool.num_gaps;
+}
+
+// returns the shard that owns the allocation, a handle or a pointer into
+// it, or null if none does
+// note: a handle is looked up in the node chunks of the shards, starting
+// with that of the calling thread, so that no unknown pointer is read
+static pool_mgr_pt _mem_shard_of(pool_mgr_pt pool_mgr, void *alloc) {
+    // a data pointer lies in the memory of a shard, a handle does not
+    const char *mem = alloc;
+    unsigned shard = _mem_shard_slice(pool_mgr, mem);
+    if (shard == pool_mgr->num_shards) {
+        unsigned first = _mem_thread_ix() % pool_mgr->num_shards;
+        for (unsigned s = 0; s < pool_mgr->num_shards; ++s) {
+            unsigned owner = (first + s) % pool_mgr->num_shards;
+            if (_mem_chunk_ix_find(pool_mgr->shards[owner], alloc) != NULL) {
+                return pool_mgr->shards[owner];
+            }
+        }
+        return NULL;
+    }
+
+    // memory lent to another shard is owned by that one
+    shard_loan_t loan;
+    unsigned seq;
+    if (_mem_shard_loan_of(pool_mgr, shard, mem, &loan, &seq) != MEM_SHARD_MAX_LOANS) {
+        return pool_mgr->shards[loan.borrower];
+    }
+
+    return pool_mgr->shards[shard];
+}
+
+// returns the shard whose own memory holds the pointer, or num_shards,
+// by a binary search of the shards in the order of their memory
+static unsigned _mem_shard_slice(pool_mgr_pt pool_mgr, const char *mem) {
+    // find the last shard that starts at or before the pointer
+    unsigned lo = 0;
+    unsigned hi = pool_mgr->num_shards;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (pool_mgr->shards[pool_mgr->shard_order[mid]]->pool.mem <= mem) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return pool_mgr->num_shards;
+    }
+
+    unsigned shard = pool_mgr->shard_order[lo - 1];
+    const char *shardMem = pool_mgr->shards[shard]->pool.mem;
+    return (mem < shardMem + pool_mgr->shard_size) ? shard : pool_mgr->num_shards;
+}
+
+// copies the loan in the slot, and returns its sequence number, or 0 if
+// the slot is free, or was given back or lent again while it was read
+// note: the slots are written under the lock of the sharded pool, and
+// read without it, the way a snapshot reads a pool
+static unsigned _mem_shard_loan_read(pool_mgr_pt pool_mgr, unsigned l, shard_loan_pt loan) {
+    shard_loan_pt entry = &pool_mgr->loans[l];
+    unsigned seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+    if (seq % 2 == 0) {
+        return 0;
+    }
+    loan->mem = entry->mem;
+    loan->size = entry->size;
+    loan->alloc = entry->alloc;
+    loan->lender = entry->lender;
+    loan->borrower = entry->borrower;
+    loan->depth = entry->depth;
+    atomic_thread_fence(memory_order_acquire);
+    return (atomic_load_explicit(&entry->seq, memory_order_relaxed) == seq) ? seq : 0;
+}
+
+// returns the slot of the loan that holds the memory in the own memory of
+// the shard, and copies the loan and its sequence number, or returns
+// MEM_SHARD_MAX_LOANS if none does
+// note: a loan can be lent on, so the innermost, deepest, loan wins; the
+// slots are only searched if the shard has lent any of its memory
+static unsigned
+        _mem_shard_loan_of(pool_mgr_pt pool_mgr,
+                           unsigned slice,
+                           const char *mem,
+                           shard_loan_pt loan,
+                           unsigned *seq) {
+    unsigned found = MEM_SHARD_MAX_LOANS;
+    if (atomic_load_explicit(&pool_mgr->slice_loans[slice], memory_order_acquire) == 0) {
+        return found;
+    }
+
+    unsigned numLoans = atomic_load_explicit(&pool_mgr->num_loans, memory_order_acquire);
+    for (unsigned l = 0; l < numLoans; ++l) {
+        shard_loan_t entry;
+        unsigned entrySeq = _mem_shard_loan_read(pool_mgr, l, &entry);
+        if (entrySeq != 0 && mem >= entry.mem && mem < entry.mem + entry.size &&
+            (found == MEM_SHARD_MAX_LOANS || entry.depth > loan->depth)) {
+            found = l;
+            loan->mem = entry.mem;
+            loan->size = entry.size;
+            loan->alloc = entry.alloc;
+            loan->lender = entry.lender;
+            loan->borrower = entry.borrower;
+            loan->depth = entry.depth;
+            *seq = entrySeq;
+        }
+    }
+    return found;
+}
+
+// tells if the allocation of the shard is a loan to another shard
+static int _mem_shard_lent(pool_mgr_pt pool_mgr, unsigned shard, void *alloc) {
+    unsigned numLoans = atomic_load_explicit(&pool_mgr->num_loans, memory_order_acquire);
+    for (unsigned l = 0; l < numLoans; ++l) {
+        shard_loan_t loan;
+        if (_mem_shard_loan_read(pool_mgr, l, &loan) != 0 &&
+            loan.lender == shard && loan.alloc == alloc) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// reallocates in the shard that owns the allocation, or else moves it to
+// the shard of the calling thread, which may borrow for it
+static void * _mem_shard_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size) {
+    // like realloc(), no allocation is a new one
+    if (alloc == NULL) {
+        return _mem_shard_new_alloc(pool_mgr, size, 1);
+    }
+
+    pool_mgr_pt shard = _mem_shard_of(pool_mgr, alloc);
+    if (shard == NULL) {
+        return NULL;
+    }
+    void *newAlloc = mem_realloc((pool_pt) shard, alloc, size);
+    size_t oldSize = mem_alloc_size((pool_pt) shard, alloc);
+    if (newAlloc != NULL || oldSize == 0) {
+        return newAlloc;
+    }
+
+    // relocate: allocate anew, copy, and deallocate the old
+    node_pt newNode = _mem_shard_new_alloc(pool_mgr, size, 1);
+    if (newNode == NULL) {
+        return NULL;
+    }
+    char *oldMem = (_mem_shard_slice(pool_mgr, alloc) < pool_mgr->num_shards) ?
+                   (char *) alloc : ((alloc_pt) alloc)->mem;
+    memcpy(newNode->alloc_record.mem, oldMem, (size < oldSize) ? size : oldSize);
+    if (_mem_shard_del_alloc(pool_mgr, alloc) != ALLOC_OK) {
+        return NULL;
+    }
+
+    // return the same kind of pointer as was passed in
+    return (oldMem == alloc) ? (void *) newNode->alloc_record.mem : (void *) newNode;
+}
+
+// closes the shards, if they hold nothing but what they lent each other,
+// and then the pool
+// note: the loans still lent are not given back, all the memory goes at once
+static alloc_status _mem_shard_close(pool_mgr_pt pool_mgr) {
+    unsigned numLoans = atomic_load_explicit(&pool_mgr->num_loans, memory_order_relaxed);
+
+    // check that every shard has no allocations other than its loans
+    for (unsigned s = 0; s < pool_mgr->num_shards; ++s) {
+        pool_mgr_pt shard = pool_mgr->shards[s];
+        _mem_pool_lock(shard);
+        _mem_drain_remote_frees(shard);
+        _mem_drain_deferred_frees(shard);
+        _mem_drain_quick_lists(shard);
+        _mem_pool_unlock(shard);
+        unsigned lent = 0;
+        for (unsigned l = 0; l < numLoans; ++l) {
+            shard_loan_t loan;
+            lent += (_mem_shard_loan_read(pool_mgr, l, &loan) != 0 && loan.lender == s);
+        }
+        if (shard->pool.num_allocs != lent) {
+            return ALLOC_NOT_FREED;
+        }
+    }
+
+    // free the shards, the tables, and the mgr
+    for (unsigned s = 0; s < pool_mgr->num_shards; ++s) {
+        _mem_pool_free(pool_mgr->shards[s]);
+    }
+    free(pool_mgr->shards);
+    free(pool_mgr->loans);
+    free(pool_mgr->shard_order);
+    free(pool_mgr->slice_loans);
+    _mem_release_pool_store(pool_mgr);
+    _mem_pool_sync_destroy(pool_mgr);
+    free(pool_mgr);
+
+    return ALLOC_OK;
+}
+
+// resets every shard, without the extents it borrowed, whose memory goes
+// back with the reset of the shard that lent it
+static void _mem_shard_reset(pool_mgr_pt pool_mgr) {
+    for (unsigned s = 0; s < pool_mgr->num_shards; ++s) {
+        pool_mgr_pt shard = pool_mgr->shards[s];
+        _mem_pool_lock(shard);
+        _mem_drain_remote_frees(shard);
+
+        // the first node of a borrowed extent goes back on the free node
+        // list with the rest
+        for (unsigned e = 1; e < shard->num_extents; ++e) {
+            shard->extents[e].first->extent_start = 0;
+            free(shard->extents[e].page_map);
+            shard->pool.total_size -= shard->extents[e].size;
+        }
+        shard->num_extents = 1;
+        shard->extent_order[0] = 0;
+        _mem_pool_reset((pool_pt) shard);
+
+        _mem_pool_unlock(shard);
+    }
+
+    // free the slots, so that a lookup still in flight sees them change
+    _mem_pool_lock(pool_mgr);
+    unsigned numLoans = atomic_load_explicit(&pool_mgr->num_loans, memory_order_relaxed);
+    for (unsigned l = 0; l < numLoans; ++l) {
+        unsigned seq = atomic_load_explicit(&pool_mgr->loans[l].seq, memory_order_relaxed);
+        if (seq % 2 != 0) {
+            atomic_store_explicit(&pool_mgr->loans[l].seq, seq + 1, memory_order_release);
+        }
+    }
+    for (unsigned s = 0; s < pool_mgr->num_shards; ++s) {
+        atomic_store_explicit(&pool_mgr->slice_loans[s], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&pool_mgr->num_loans, 0, memory_order_relaxed);
+    pool_mgr->pool.alloc_size = 0;
+    pool_mgr->pool.num_allocs = 0;
+    pool_mgr->pool.num_gaps = pool_mgr->num_shards;
+    _mem_pool_unlock(pool_mgr);
+}
+
+// inspects the shards in turn, each with the extents it borrowed and
+// without the allocations it lent
+// note: the totals of the pool are kept current by the shards as they
+// unlock, see _mem_shard_report()
+static void _mem_shard_inspect(pool_mgr_pt pool_mgr,
+                               pool_segment_pt *segments,
+                               unsigned *num_segments) {
+    pool_segment_pt segmentArray = NULL;
+    unsigned numSegments = 0;
+
+    for (unsigned s = 0; s < pool_mgr->num_shards; ++s) {
+        pool_mgr_pt shard = pool_mgr->shards[s];
+        _mem_pool_lock_read(shard);
+        _mem_drain_remote_frees(shard);
+
+        // make room for every segment of the shard
+        pool_segment_pt grown = realloc(segmentArray,
+                                        sizeof(pool_segment_t) * (numSegments + shard->used_nodes));
+        if (grown == NULL) {
+            _mem_pool_unlock(shard);
+            free(segmentArray);
+            *segments = NULL;
+            *num_segments = 0;
+            return;
+        }
+        segmentArray = grown;
+
+        for (node_pt node = shard->node_heap; node != NULL; node = node->next) {
+            if (node->allocated && _mem_shard_lent(pool_mgr, s, node)) {
+                continue;
+            }
+            segmentArray[numSegments].size = node->alloc_record.size;
+            segmentArray[numSegments].allocated = node->allocated;
+            numSegments++;
+        }
+
+        _mem_pool_unlock(shard);
+    }
+
+    // "return" the values:
+    *segments = segmentArray;
+    *num_segments = numSegments;
+}
+
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr) {
+    // see above
+    // note: the nodes are handed out to the user as allocation handles,
+    // so they must never move; instead of copying the heap over to a
+    // larger array, add another chunk, and only once no unused node is left
+    if (pool_mgr->free_nodes != NULL ||
+        pool_mgr->node_bump < MEM_NODE_HEAP_CHUNK_CAPACITY) {
+        return ALLOC_OK;
+    }
+
+    // the chunk table holds pointers only, so it can move
+    if (pool_mgr->num_node_blocks == pool_mgr->node_blocks_capacity) {
+        unsigned newCapacity = pool_mgr->node_blocks_capacity * MEM_NODE_HEAP_EXPAND_FACTOR;
+        node_pt *nodeBlocks = realloc(pool_mgr->node_blocks, sizeof(node_pt) * newCapacity);
+        if (nodeBlocks == NULL) {
+            return ALLOC_FAIL;
+        }
+        pool_mgr->node_blocks = nodeBlocks;
+        pool_mgr->node_blocks_capacity = newCapacity;
+    }
+
+    // note: the nodes of the chunk are initialized as they are claimed, but
+    // zeroed first, so a snapshot never follows a link that was not written
+    node_pt chunk = calloc(MEM_NODE_HEAP_CHUNK_CAPACITY, sizeof(node_t));
+    if (chunk == NULL) {
+        return ALLOC_FAIL;
+    }
+    if (_mem_chunk_ix_add(pool_mgr, chunk) != ALLOC_OK) {
+        free(chunk);
+        return ALLOC_FAIL;
+    }
+    pool_mgr->node_blocks[pool_mgr->num_node_blocks] = chunk;
+    pool_mgr->num_node_blocks++;
+    pool_mgr->node_bump = 0;
+    pool_mgr->total_nodes = pool_mgr->total_nodes + MEM_NODE_HEAP_CHUNK_CAPACITY;
+
+    return ALLOC_OK;
+}
+
+// takes a released node off the free node list, or else the next node of
+// the last chunk that was never used, and marks it used
+static node_pt _mem_claim_node(pool_mgr_pt pool_mgr) {
+    if (_mem_resize_node_heap(pool_mgr) != ALLOC_OK) {
+        return NULL;
+    }
+    node_pt node = pool_mgr->free_nodes;
+    if (node != NULL) {
+        pool_mgr->free_nodes = node->next;
+    } else {
+        node = &pool_mgr->node_blocks[pool_mgr->num_node_blocks - 1][pool_mgr->node_bump];
+        pool_mgr->node_bump++;
+    }
+
+    node->used = 1;
+    node->allocated = 0;
+    node->extent_start = 0;
+    node->quick = 0;
+    node->cached = 0;
+    node->pinned = 0;
+    node->align_shift = 0;
+    node->next = NULL;
+    node->prev = NULL;
+    pool_mgr->used_nodes++;
+    if (pool_mgr->used_nodes > pool_mgr->peak_used_nodes) {
+        pool_mgr->peak_used_nodes = pool_mgr->used_nodes;
+    }
+
+    return node;
+}
+
+// marks the node unused and puts it back on the free node list
+static void _mem_release_node(pool_mgr_pt pool_mgr, node_pt node) {
+    node->used = 0;
+    node->allocated = 0;
+    node->prev = NULL;
+    node->next = pool_mgr->free_nodes;
+    pool_mgr->free_nodes = node;
+    pool_mgr->used_nodes--;
+}
+
+// adds the chunk to the chunk index, under the spans of its first and last
+// byte, which are the same or next to each other, as a span is as long as
+// a chunk; a full index is replaced by one of twice the capacity, which is
+// filled before it is published
+static alloc_status _mem_chunk_ix_add(pool_mgr_pt pool_mgr, node_pt chunk) {
+    const uintptr_t spanSize = sizeof(node_t) * MEM_NODE_HEAP_CHUNK_CAPACITY;
+    uintptr_t first = (uintptr_t) chunk / spanSize;
+    uintptr_t last = ((uintptr_t) chunk + spanSize - 1) / spanSize;
+
+    chunk_ix_pt chunkIx = atomic_load_explicit(&pool_mgr->chunk_ix, memory_order_relaxed);
+    if (chunkIx == NULL ||
+        ((float) chunkIx->num_entries + 2) / chunkIx->capacity > MEM_CHUNK_IX_FILL_FACTOR) {
+        unsigned newCapacity = (chunkIx == NULL) ?
+                               MEM_CHUNK_IX_INIT_CAPACITY :
+                               chunkIx->capacity * MEM_CHUNK_IX_EXPAND_FACTOR;
+        chunk_ix_pt newIx = malloc(sizeof(chunk_ix_t));
+        atomic_uintptr_t *spans = malloc(sizeof(atomic_uintptr_t) * newCapacity);
+        node_pt *chunks = malloc(sizeof(node_pt) * newCapacity);
+        if (newIx == NULL || spans == NULL || chunks == NULL) {
+            free(chunks);
+            free(spans);
+            free(newIx);
+            return ALLOC_FAIL;
+        }
+        newIx->retired = chunkIx;
+        newIx->capacity = newCapacity;
+        newIx->num_entries = 0;
+        newIx->spans = spans;
+        newIx->chunks = chunks;
+        for (unsigned e = 0; e < newCapacity; ++e) {
+            atomic_init(&spans[e], 0);
+        }
+        for (unsigned e = 0; chunkIx != NULL && e < chunkIx->capacity; ++e) {
+            uintptr_t span = atomic_load_explicit(&chunkIx->spans[e], memory_order_relaxed);
+            if (span != 0) {
+                _mem_chunk_ix_insert(newIx, span - 1, chunkIx->chunks[e]);
+            }
+        }
+        atomic_store_explicit(&pool_mgr->chunk_ix, newIx, memory_order_release);
+        chunkIx = newIx;
+    }
+
+    _mem_chunk_ix_insert(chunkIx, first, chunk);
+    if (last != first) {
+        _mem_chunk_ix_insert(chunkIx, last, chunk);
+    }
+    return ALLOC_OK;
+}
+
+// puts the entry in the first empty place from the hash of its span on,
+// writing the chunk before it publishes the span
+static void _mem_chunk_ix_insert(chunk_ix_pt chunk_ix, uintptr_t span, node_pt chunk) {
+    unsigned mask = chunk_ix->capacity - 1;
+    unsigned e = (unsigned) (((uint64_t) span * 0x9E3779B97F4A7C15u) >> 32) & mask;
+    while (atomic_load_explicit(&chunk_ix->spans[e], memory_order_relaxed) != 0) {
+        e = (e + 1) & mask;
+    }
+    chunk_ix->chunks[e] = chunk;
+    atomic_store_explicit(&chunk_ix->spans[e], span + 1, memory_order_release);
+    chunk_ix->num_entries++;
+}
+
+// returns the pointer as a node, if it is the start of a node in one of
+// the chunks of the pool, or null, without reading it
+static node_pt _mem_chunk_ix_find(pool_mgr_pt pool_mgr, const void *alloc) {
+    chunk_ix_pt chunkIx = atomic_load_explicit(&pool_mgr->chunk_ix, memory_order_acquire);
+    if (chunkIx == NULL) {
+        return NULL;
+    }
+    const uintptr_t spanSize = sizeof(node_t) * MEM_NODE_HEAP_CHUNK_CAPACITY;
+    uintptr_t addr = (uintptr_t) alloc;
+    uintptr_t span = addr / spanSize;
+
+    unsigned mask = chunkIx->capacity - 1;
+    unsigned e = (unsigned) (((uint64_t) span * 0x9E3779B97F4A7C15u) >> 32) & mask;
+    uintptr_t entry;
+    while ((entry = atomic_load_explicit(&chunkIx->spans[e], memory_order_acquire)) != 0) {
+        uintptr_t chunk = (uintptr_t) chunkIx->chunks[e];
+        if (entry == span + 1 && addr >= chunk && addr - chunk < spanSize &&
+            (addr - chunk) % sizeof(node_t) == 0) {
+            return (node_pt) alloc;
+        }
+        e = (e + 1) & mask;
+    }
+    return NULL;
+}
+
+// frees the chunk index and the ones it replaced
+static void _mem_chunk_ix_free(pool_mgr_pt pool_mgr) {
+    chunk_ix_pt chunkIx = atomic_load_explicit(&pool_mgr->chunk_ix, memory_order_relaxed);
+    while (chunkIx != NULL) {
+        chunk_ix_pt retired = chunkIx->retired;
+        free(chunkIx->spans);
+        free(chunkIx->chunks);
+        free(chunkIx);
+        chunkIx = retired;
+    }
+    atomic_store_explicit(&pool_mgr->chunk_ix, NULL, memory_order_relaxed);
+}
+
+// returns the number of extents that start at or before the pointer, so
+// the position in the order of the extents after them
+static unsigned _mem_extent_order_pos(pool_mgr_pt pool_mgr, const char *mem) {
+    unsigned lo = 0;
+    unsigned hi = pool_mgr->num_extents;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (pool_mgr->extents[pool_mgr->extent_order[mid]].mem <= mem) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// returns the extent that holds the pointer, or null if none does: the
+// last extent by address that starts at or before it, found by binary
+// search, or else the innermost of the extents that one lies in
+// note: a shard can borrow back memory that it lent, which lies in one of
+// its own extents, and lend on memory it borrowed; an extent added later
+// lies within, or apart from, the ones before it, so the innermost extent
+// that holds the pointer wins, as it is the last one added
+static extent_pt _mem_find_extent(pool_mgr_pt pool_mgr, const char *mem) {
+    unsigned pos = _mem_extent_order_pos(pool_mgr, mem);
+    if (pos == 0) {
+        return NULL;
+    }
+
+    unsigned e = pool_mgr->extent_order[pos - 1];
+    while (e != MEM_EXTENT_NIL && mem >= pool_mgr->extents[e].mem + pool_mgr->extents[e].size) {
+        e = pool_mgr->extents[e].outer;
+    }
+    return (e != MEM_EXTENT_NIL) ? &pool_mgr->extents[e] : NULL;
+}
+
+// attaches a new extent of the given size to a growable pool, or the
+// memory lent to a shard: its single gap goes at the end of the segment
+// list and into the gap index, and the pool size grows by it; returns the
+// node of the gap, or null on error
+static node_pt _mem_add_extent(pool_mgr_pt pool_mgr, size_t size, char *mem) {
+    if (size == 0 || size > (size_t) -1 - pool_mgr->pool.total_size) {
+        return NULL;
+    }
+
+    // the extent table holds no pointers into itself, so it can move, and
+    // so can the order of the extents
+    if (pool_mgr->num_extents == pool_mgr->extents_capacity) {
+        unsigned newCapacity = pool_mgr->extents_capacity * MEM_EXTENT_EXPAND_FACTOR;
+        extent_pt extents = realloc(pool_mgr->extents, sizeof(extent_t) * newCapacity);
+        if (extents == NULL) {
+            return NULL;
+        }
+        pool_mgr->extents = extents;
+        unsigned *extentOrder = realloc(pool_mgr->extent_order, sizeof(unsigned) * newCapacity);
+        if (extentOrder == NULL) {
+            return NULL;
+        }
+        pool_mgr->extent_order = extentOrder;
+        pool_mgr->extents_capacity = newCapacity;
+    }
+
+    // allocate the memory, unless it is lent, its page map, and the node
+    // for its gap
+    unsigned borrowed = (mem != NULL);
+    if (! borrowed) {
+        mem = malloc(size);
+    }
+    node_pt *pageMap = (mem != NULL) ? _mem_page_map_new(size) : NULL;
+    node_pt node = (pageMap != NULL) ? _mem_claim_node(pool_mgr) : NULL;
+    if (node == NULL) {
+        free(pageMap);
+        if (! borrowed) {
+            free(mem);
+        }
+        return NULL;
+    }
+
+    // find the end of the segment list, from the start of the last extent
+    // note: the pool at least doubles with each extent, so the walk is
+    // paid for by the allocations that filled it
+    node_pt last = pool_mgr->extents[pool_mgr->num_extents - 1].first;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+
+    node->alloc_record.mem = mem;
+    node->alloc_record.size = size;
+    node->extent_start = 1;
+    node->prev = last;
+    last->next = node;
+
+    // place the extent in the order after the ones that start at or
+    // before it, so after any it lies in
+    extent_pt outer = _mem_find_extent(pool_mgr, mem);
+    unsigned pos = _mem_extent_order_pos(pool_mgr, mem);
+    memmove(&pool_mgr->extent_order[pos + 1], &pool_mgr->extent_order[pos],
+            sizeof(unsigned) * (pool_mgr->num_extents - pos));
+    pool_mgr->extent_order[pos] = pool_mgr->num_extents;
+
+    extent_pt extent = &pool_mgr->extents[pool_mgr->num_extents];
+    extent->mem = mem;
+    extent->size = size;
+    extent->page_map = pageMap;
+    extent->granule_map = pageMap + (((size - 1) >> MEM_PAGE_MAP_SHIFT) + 1);
+    extent->first = node;
+    extent->borrowed = borrowed;
+    extent->outer = (outer != NULL) ? (unsigned) (outer - pool_mgr->extents) : MEM_EXTENT_NIL;
+    pool_mgr->num_extents++;
+
+    // update metadata (total_size), and add the gap to the gap index
+    pool_mgr->pool.total_size = pool_mgr->pool.total_size + size;
+    if (_mem_add_to_gap_ix(pool_mgr, size, node) != ALLOC_OK) {
+        return NULL;
+    }
+
+    return node;
+}
+
+// detaches an extent that is a single gap again, as memory lent to a shard
+// is once it is given back: its gap leaves the gap index and the segment
+// list, and the pool size shrinks by it; returns ALLOC_FAIL if the gap is
+// not in the gap index
+static alloc_status _mem_remove_extent(pool_mgr_pt pool_mgr, extent_pt extent) {
+    node_pt node = extent->first;
+    if (_mem_remove_from_gap_ix(pool_mgr, node->alloc_record.size, node) != ALLOC_OK) {
+        return ALLOC_FAIL;
+    }
+
+    // unlink the node of the gap, which is never the head of the list
+    node->prev->next = node->next;
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    node->extent_start = 0;
+    _mem_release_node(pool_mgr, node);
+
+    // a compaction cursor in the extent starts over
+    if (pool_mgr->compact_cursor >= extent->mem &&
+        pool_mgr->compact_cursor < extent->mem + extent->size) {
+        pool_mgr->compact_cursor = NULL;
+    }
+
+    // update metadata (total_size), and close the gap in the extent table
+    // and in the order, where the extents after it move down by one
+    // note: no extent lies in it, as it is a single gap
+    pool_mgr->pool.total_size = pool_mgr->pool.total_size - extent->size;
+    free(extent->page_map);
+    unsigned e = (unsigned) (extent - pool_mgr->extents);
+    memmove(extent, extent + 1, sizeof(extent_t) * (pool_mgr->num_extents - e - 1));
+    pool_mgr->num_extents--;
+    unsigned n = 0;
+    for (unsigned i = 0; i <= pool_mgr->num_extents; ++i) {
+        unsigned other = pool_mgr->extent_order[i];
+        if (other != e) {
+            pool_mgr->extent_order[n++] = (other > e) ? other - 1 : other;
+        }
+    }
+    for (unsigned i = 0; i < pool_mgr->num_extents; ++i) {
+        if (pool_mgr->extents[i].outer != MEM_EXTENT_NIL && pool_mgr->extents[i].outer > e) {
+            pool_mgr->extents[i].outer--;
+        }
+    }
+
+    return ALLOC_OK;
+}
+
+// allocates the page map of an extent of the given size, zeroed, followed
+// by its granule map
+static node_pt *_mem_page_map_new(size_t size) {
+    size_t pages = ((size - 1) >> MEM_PAGE_MAP_SHIFT) + 1;
+    size_t granules = ((size - 1) >> MEM_PAGE_MAP_GRANULE_SHIFT) + 1;
+    return calloc(pages + granules, sizeof(node_pt));
+}
+
+// points the page map at the node, for the pages whose start it holds:
+// all of them for an allocation, only the first and the last for a gap;
+// a page whose start lies inside a gap holds no allocation, unless it is
+// the last one, so the pages in between are never looked up; the granule
+// map the same, but only for the granules of the first and the last page
+// of an allocation, as no other segment starts in the pages in between
+static void _mem_page_map_set(pool_mgr_pt pool_mgr, node_pt node) {
+    extent_pt extent = _mem_find_extent(pool_mgr, node->alloc_record.mem);
+    if (extent == NULL || node->alloc_record.size == 0) {
+        return;
+    }
+    size_t offset = (size_t) (node->alloc_record.mem - extent->mem);
+    size_t end = offset + node->alloc_record.size - 1;
+    size_t pageSize = (size_t) 1 << MEM_PAGE_MAP_SHIFT;
+    size_t first = (offset + pageSize - 1) >> MEM_PAGE_MAP_SHIFT;
+    size_t last = end >> MEM_PAGE_MAP_SHIFT;
+    if (first <= last) {
+        if (node->allocated) {
+            for (size_t page = first; page <= last; ++page) {
+                extent->page_map[page] = node;
+            }
+        } else {
+            extent->page_map[first] = node;
+            extent->page_map[last] = node;
+        }
+    }
+
+    size_t granuleSize = (size_t) 1 << MEM_PAGE_MAP_GRANULE_SHIFT;
+    size_t pageGranules = (size_t) 1 << (MEM_PAGE_MAP_SHIFT - MEM_PAGE_MAP_GRANULE_SHIFT);
+    first = (offset + granuleSize - 1) >> MEM_PAGE_MAP_GRANULE_SHIFT;
+    last = end >> MEM_PAGE_MAP_GRANULE_SHIFT;
+    if (first > last) {
+        return;
+    }
+
+    if (node->allocated) {
+        // past the granules of the first page, on from those of the last
+        size_t firstPageEnd = ((offset >> MEM_PAGE_MAP_SHIFT) + 1) * pageGranules;
+        size_t lastPageStart = (end >> MEM_PAGE_MAP_SHIFT) * pageGranules;
+        for (size_t granule = first; granule <= last && granule < firstPageEnd; ++granule) {
+            extent->granule_map[granule] = node;
+        }
+        for (size_t granule = (lastPageStart > firstPageEnd) ? lastPageStart : firstPageEnd;
+             granule <= last; ++granule) {
+            extent->granule_map[granule] = node;
+        }
+    } else {
+        extent->granule_map[first] = node;
+        extent->granule_map[last] = node;
+    }
+}
+
+// returns the node of the segment that holds the start of the granule of
+// the pointer into the extent, or else of its page, or null if neither
+// entry holds it
+// note: an entry may be stale, but then it does not hold the start any
+// more; the granule entry is only stale for a pointer into an allocation
+// if the allocation holds the whole page, and then the page entry is not
+static node_pt _mem_page_map_start(extent_pt extent, const char *mem) {
+    size_t offset = (size_t) (mem - extent->mem);
+    size_t granule = offset >> MEM_PAGE_MAP_GRANULE_SHIFT;
+    node_pt node = extent->granule_map[granule];
+    if (_mem_segment_holds(node, extent->mem + (granule << MEM_PAGE_MAP_GRANULE_SHIFT))) {
+        return node;
+    }
+    size_t page = offset >> MEM_PAGE_MAP_SHIFT;
+    node = extent->page_map[page];
+    if (_mem_segment_holds(node, extent->mem + (page << MEM_PAGE_MAP_SHIFT))) {
+        return node;
+    }
+    return NULL;
+}
+
+// checks that the node is of a segment, and that the segment holds the
+// byte at the pointer
+static int _mem_segment_holds(node_pt node, const char *mem) {
+    return node != NULL && node->used &&
+           node->alloc_record.mem <= mem &&
+           node->alloc_record.mem + node->alloc_record.size > mem;
+}
+
+// returns the node of the segment that holds the pointer into the extent:
+// the granule or page map gives the segment holding the start of the
+// granule, and the segments that start later in the same granule follow
+// it in the list; returns null if the pointer is not inside an allocation
+// note: the walk passes the segments that start in the granule before the
+// pointer, so a lookup takes at most one step per byte of a granule, and
+// as many as there are allocations of the pool in none
+static node_pt _mem_page_map_find(extent_pt extent, const char *mem) {
+    node_pt node = _mem_page_map_start(extent, mem);
+    if (node == NULL) {
+        return NULL;
+    }
+    while (node->next != NULL && ! node->next->extent_start &&
+           node->next->alloc_record.mem <= mem) {
+        node = node->next;
+    }
+    return node->allocated ? node : NULL;
+}
+
+// returns the node of an allocation given either its handle, or a pointer
+// into its data
+static node_pt _mem_alloc_node(pool_mgr_pt pool_mgr, void *alloc) {
+    extent_pt extent = _mem_find_extent(pool_mgr, alloc);
+    if (extent != NULL) {
+        return _mem_page_map_find(extent, alloc);
+    }
+    return _mem_chunk_ix_find(pool_mgr, alloc);
+}
+
+// allocates the smallest power-of-two block that holds the size: takes the
+// smallest free block of at least that order off the order's free list and
+// halves it until it has the right order, putting the upper halves back on
+// the free lists
+static void * _mem_buddy_new_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    size_t blockSize = MEM_BUDDY_MIN_BLOCK;
+    while (blockSize < size) {
+        blockSize <<= 1;
+        if (blockSize == 0 || blockSize > pool_mgr->pool.total_size) {
+            return NULL;
+        }
+    }
+
+    // the order free lists are the (exact) power-of-two size classes
+    unsigned gapIx = _mem_find_class_gap_ix(pool_mgr, blockSize);
+    if (gapIx == MEM_GAP_IX_NIL) {
+        return NULL;
+    }
+    node_pt block = pool_mgr->gap_ix[gapIx].node;
+    if (_mem_remove_from_gap_ix(pool_mgr, block->alloc_record.size, block) != ALLOC_OK) {
+        return NULL;
+    }
+
+    // split down to the requested order
+    while (block->alloc_record.size > blockSize) {
+        node_pt buddy = _mem_claim_node(pool_mgr);
+        if (buddy == NULL) {
+            _mem_add_to_gap_ix(pool_mgr, block->alloc_record.size, block);
+            return NULL;
+        }
+        block->alloc_record.size >>= 1;
+
+        buddy->allocated = 0;
+        buddy->alloc_record.size = block->alloc_record.size;
+        buddy->alloc_record.mem = block->alloc_record.mem + block->alloc_record.size;
+        buddy->prev = block;
+        buddy->next = block->next;
+        if (block->next != NULL) {
+            block->next->prev = buddy;
+        }
+        block->next = buddy;
+
+        if (_mem_add_to_gap_ix(pool_mgr, buddy->alloc_record.size, buddy) != ALLOC_OK) {
+            return NULL;
+        }
+    }
+
+    // update metadata (num_allocs, alloc_size)
+    // note: alloc_size counts whole blocks, like the pool inspection
+    block->allocated = 1;
+    _mem_page_map_set(pool_mgr, block);
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += blockSize;
+    pool_mgr->total_allocs++;
+    _mem_stats_peak(pool_mgr);
+
+    return (alloc_pt) block;
+}
+
+// frees the block and merges it with its buddy for as long as the buddy is
+// a free block of the same order; the buddy's offset differs from the
+// block's only in the bit of the block size, and is always a list neighbour
+static alloc_status _mem_buddy_del_alloc(pool_mgr_pt pool_mgr, node_pt node) {
+    if (! node->used || ! node->allocated) {
+        return ALLOC_FAIL;
+    }
+
+    // update metadata (num_allocs, alloc_size)
+    node->allocated = 0;
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= node->alloc_record.size;
+    pool_mgr->total_frees++;
+
+    while (node->alloc_record.size < pool_mgr->pool.total_size) {
+        size_t offset = (size_t) (node->alloc_record.mem - pool_mgr->pool.mem);
+        char *buddyMem = pool_mgr->pool.mem + (offset ^ node->alloc_record.size);
+        node_pt buddy = (buddyMem > node->alloc_record.mem) ? node->next : node->prev;
+
+        if (buddy == NULL || buddy->allocated ||
+            buddy->alloc_record.mem != buddyMem ||
+            buddy->alloc_record.size != node->alloc_record.size) {
+            break;
+        }
+        if (_mem_remove_from_gap_ix(pool_mgr, buddy->alloc_record.size, buddy) != ALLOC_OK) {
+            return ALLOC_FAIL;
+        }
+
+        // the lower of the two survives, with double the size
+        node_pt lower = (buddyMem > node->alloc_record.mem) ? node : buddy;
+        node_pt upper = (lower == node) ? buddy : node;
+        lower->alloc_record.size <<= 1;
+        lower->next = upper->next;
+        if (upper->next != NULL) {
+            upper->next->prev = lower;
+        }
+        upper->next = NULL;
+        _mem_release_node(pool_mgr, upper);
+        node = lower;
+    }
+
+    return _mem_add_to_gap_ix(pool_mgr, node->alloc_record.size, node);
+}
+
+// returns 1 if the slot next to the given one (side -1 or +1) exists and
+// is free, and 0 otherwise
+static int _mem_slab_slot_free(pool_mgr_pt pool_mgr, unsigned slot, int side) {
+    if ((side < 0 && slot == 0) || (side > 0 && slot + 1 >= pool_mgr->slab_count)) {
+        return 0;
+    }
+    unsigned neighbour = (side < 0) ? slot - 1 : slot + 1;
+    return ! (pool_mgr->slab_map[neighbour / 64] & ((uint64_t) 1 << (neighbour % 64)));
+}
+
+// allocates a slot: the most recently freed one, or else the first slot
+// that has never been allocated; both are O(1), and the gap count follows
+// from the two neighbouring bits
+static void * _mem_slab_new_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    if (size > pool_mgr->slab_slot_size) {
+        return NULL;
+    }
+
+    // take a slot off the free slot list, or bump
+    unsigned slot;
+    if (pool_mgr->slab_free != MEM_GAP_IX_NIL) {
+        slot = pool_mgr->slab_free;
+        memcpy(&pool_mgr->slab_free,
+               pool_mgr->pool.mem + (size_t) slot * pool_mgr->slab_slot_size,
+               sizeof(unsigned));
+    } else if (pool_mgr->slab_bump < pool_mgr->slab_count) {
+        slot = pool_mgr->slab_bump++;
+    } else {
+        return NULL;
+    }
+
+    // a slot between two gaps splits one, between two allocations fills one
+    int freeNeighbours = _mem_slab_slot_free(pool_mgr, slot, -1) +
+                         _mem_slab_slot_free(pool_mgr, slot, 1);
+    pool_mgr->pool.num_gaps = pool_mgr->pool.num_gaps + freeNeighbours - 1;
+
+    // update metadata (num_allocs, alloc_size)
+    // note: alloc_size counts whole slots
+    pool_mgr->slab_map[slot / 64] |= (uint64_t) 1 << (slot % 64);
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += pool_mgr->slab_slot_size;
+    pool_mgr->total_allocs++;
+    _mem_stats_peak(pool_mgr);
+
+    return pool_mgr->pool.mem + (size_t) slot * pool_mgr->slab_slot_size;
+}
+
+// frees a slot, pushing it on the free slot list
+static alloc_status _mem_slab_del_alloc(pool_mgr_pt pool_mgr, void *alloc) {
+    char *mem = alloc;
+    if (mem < pool_mgr->pool.mem ||
+        mem >= pool_mgr->pool.mem + pool_mgr->pool.total_size) {
+        return ALLOC_FAIL;
+    }
+
+    // make sure it is the start of an allocated slot
+    size_t offset = (size_t) (mem - pool_mgr->pool.mem);
+    unsigned slot = (unsigned) (offset / pool_mgr->slab_slot_size);
+    uint64_t bit = (uint64_t) 1 << (slot % 64);
+    if (offset % pool_mgr->slab_slot_size != 0 ||
+        ! (pool_mgr->slab_map[slot / 64] & bit)) {
+        return ALLOC_FAIL;
+    }
+    pool_mgr->slab_map[slot / 64] &= ~bit;
+
+    // a slot between two gaps merges them, between two allocations adds one
+    int freeNeighbours = _mem_slab_slot_free(pool_mgr, slot, -1) +
+                         _mem_slab_slot_free(pool_mgr, slot, 1);
+    pool_mgr->pool.num_gaps = pool_mgr->pool.num_gaps + 1 - freeNeighbours;
+
+    // update metadata (num_allocs, alloc_size)
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= pool_mgr->slab_slot_size;
+    pool_mgr->total_frees++;
+
+    // the freed slot holds the previous head of the free slot list
+    memcpy(mem, &pool_mgr->slab_free, sizeof(unsigned));
+    pool_mgr->slab_free = slot;
+
+    return ALLOC_OK;
+}
+
+// reports every allocated slot as a segment, and every run of free slots
+// as a single gap, like the node list of the other policies
+static void _mem_slab_inspect(pool_mgr_pt pool_mgr,
+                              pool_segment_pt *segments,
+                              unsigned *num_segments) {
+    unsigned numSegments = pool_mgr->pool.num_allocs + pool_mgr->pool.num_gaps;
+    pool_segment_pt segmentArray = calloc(numSegments, sizeof(pool_segment_t));
+    if (segmentArray == NULL){
+        return;
+    }
+
+    unsigned s = 0;
+    for (unsigned slot = 0; slot < pool_mgr->slab_count; ++slot) {
+        unsigned long allocated =
+                (pool_mgr->slab_map[slot / 64] >> (slot % 64)) & 1;
+        if (allocated || s == 0 || segmentArray[s - 1].allocated) {
+            segmentArray[s].allocated = allocated;
+            s++;
+        }
+        segmentArray[s - 1].size += pool_mgr->slab_slot_size;
+    }
+
+    // "return" the values:
+    *segments = segmentArray;
+    *num_segments = s;
 }
 
+// allocates the next size bytes of the pool, from the next aligned address,
+// if there are that many left; the padding is skipped
+static void * _mem_arena_new_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    size_t padding = _mem_align_padding(pool_mgr->pool.mem + pool_mgr->arena_top, alignment);
+    if (padding > pool_mgr->pool.total_size - pool_mgr->arena_top ||
+        size > pool_mgr->pool.total_size - pool_mgr->arena_top - padding) {
+        return NULL;
+    }
+    char *mem = pool_mgr->pool.mem + pool_mgr->arena_top + padding;
+    pool_mgr->arena_top += padding + size;
 
+    // update metadata (num_allocs, alloc_size, num_gaps)
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += size;
+    pool_mgr->total_allocs++;
+    _mem_stats_peak(pool_mgr);
+    pool_mgr->pool.num_gaps = (pool_mgr->arena_top < pool_mgr->pool.total_size) ? 1 : 0;
 
-/***********************************/
-/*                                 */
-/* Definitions of static functions */
-/*                                 */
-/***********************************/
-static alloc_status _mem_resize_pool_store() {
-    // check if necessary
+    return mem;
+}
 
-    if (((float) pool_store_size / pool_store_capacity)
-        > MEM_POOL_STORE_FILL_FACTOR) {
-        pool_store = realloc(pool_store, sizeof(pool_mgr_pt)*(pool_store_size * MEM_POOL_STORE_EXPAND_FACTOR));
-        pool_store_capacity = pool_store_capacity + (pool_store_size*MEM_POOL_STORE_EXPAND_FACTOR - pool_store_size);
-        pool_store_size = pool_store_size *MEM_POOL_STORE_EXPAND_FACTOR;
+// reports all the allocations as a single segment, followed by the gap
+static void _mem_arena_inspect(pool_mgr_pt pool_mgr,
+                               pool_segment_pt *segments,
+                               unsigned *num_segments) {
+    pool_segment_pt segmentArray = calloc(2, sizeof(pool_segment_t));
+    if (segmentArray == NULL){
+        return;
     }
 
-    // don't forget to update capacity variables
+    unsigned s = 0;
+    if (pool_mgr->arena_top > 0) {
+        segmentArray[s].size = pool_mgr->arena_top;
+        segmentArray[s].allocated = 1;
+        s++;
+    }
+    if (pool_mgr->arena_top < pool_mgr->pool.total_size) {
+        segmentArray[s].size = pool_mgr->pool.total_size - pool_mgr->arena_top;
+        segmentArray[s].allocated = 0;
+        s++;
+    }
 
-    return ALLOC_OK;
+    // "return" the values:
+    *segments = segmentArray;
+    *num_segments = s;
 }
 
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr) {
-    // see above
-    if(((float) pool_mgr->used_nodes/pool_mgr->total_nodes) > MEM_NODE_HEAP_FILL_FACTOR){
-        //create new heap
-        node_pt tempNodeHeap = calloc(pool_mgr->total_nodes*MEM_NODE_HEAP_EXPAND_FACTOR, sizeof(node_t));
-        _mem_invalidate_gap_ix(pool_mgr);
-        node_pt currentNode = pool_mgr->node_heap;
-        unsigned check = 1;
-        unsigned newNodeIX = 0;
-        while(check){
-            if (currentNode == NULL){
-                check = 0;
-            }
-            else{
-                if(newNodeIX > 0) {
-                    tempNodeHeap[newNodeIX].prev = &tempNodeHeap[newNodeIX-1];
-                    tempNodeHeap[newNodeIX-1].next = &tempNodeHeap[newNodeIX];
-                }
-                tempNodeHeap[newNodeIX].used = currentNode->used;
-                tempNodeHeap[newNodeIX].allocated = currentNode->allocated;
-                tempNodeHeap[newNodeIX].alloc_record.size = currentNode->alloc_record.size;
-                tempNodeHeap[newNodeIX].alloc_record.mem = currentNode->alloc_record.mem;
+// boundary-tag pools: every block, allocated or free, starts with a header
+// tag and ends with a footer tag, each holding the size of the whole block
+// with the allocated flag in the low bit; free blocks hold the links of
+// their size class free list right after the header:
+//
+//   | size|1 | data ...                   | size|1 |
+//   | size|0 | prev | next | ...          | size|0 |
+//
+// the header of the next block follows the footer, and the footer of the
+// previous block precedes the header, so both neighbours are O(1) away
 
-                if(currentNode->used && (currentNode->allocated == 0)){
-                    _mem_add_to_gap_ix(pool_mgr, tempNodeHeap[newNodeIX].alloc_record.size, &tempNodeHeap[newNodeIX]);
-                }
+// turns the whole pool into a single free block
+static void _mem_tag_open(pool_mgr_pt pool_mgr) {
+    _mem_tag_write(pool_mgr->pool.mem, pool_mgr->pool.total_size, 0);
+    _mem_tag_push(pool_mgr, pool_mgr->pool.mem);
+}
 
-                newNodeIX ++;
-                currentNode = currentNode->next;
-            }
+// allocates a block for the size plus the tags from the first non-empty
+// sufficient size class, splitting off the rest if it can be a block; with
+// an alignment above the tag size, the padding in front of the block is
+// split off as a free block too, so it has to be at least a minimal block
+static void * _mem_tag_new_alloc(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    if (size > pool_mgr->pool.total_size) {
+        return NULL;
+    }
+    size_t blockSize = _mem_tag_block_size(size);
+
+    // note: every data pointer is on a tag boundary
+    size_t fitSize = blockSize;
+    if (alignment > MEM_TAG_SIZE) {
+        if (alignment > pool_mgr->pool.total_size) {
+            return NULL;
+        }
+        fitSize += alignment + MEM_TAG_MIN_BLOCK;
+    }
+
+    // every block in a class above the size's own is sufficient,
+    // otherwise search the size's own class
+    unsigned sizeClass = _mem_size_class(fitSize);
+    uint64_t fitMap = (sizeClass + 1 < MEM_GAP_CLASS_COUNT) ?
+                      pool_mgr->gap_class_map & (~(uint64_t) 0 << (sizeClass + 1)) : 0;
+    char *block;
+    if (fitMap != 0) {
+        block = pool_mgr->tag_class_head[_mem_lowest_bit(fitMap)];
+    } else {
+        block = pool_mgr->tag_class_head[sizeClass];
+        while (block != NULL && _mem_tag_size(block) < fitSize) {
+            block = _mem_tag_links(block)[1];
+        }
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+    _mem_tag_unlink(pool_mgr, block);
+    size_t freeSize = _mem_tag_size(block);
+
+    // split off the padding in front, if the data is not aligned
+    size_t padding = (alignment > MEM_TAG_SIZE) ?
+                     _mem_align_padding(block + MEM_TAG_SIZE, alignment) : 0;
+    if (padding > 0) {
+        while (padding < MEM_TAG_MIN_BLOCK) {
+            padding += alignment;
         }
+        _mem_tag_write(block, padding, 0);
+        _mem_tag_push(pool_mgr, block);
+        block += padding;
+        freeSize -= padding;
+    }
+
+    // split off the rest, if it is large enough to be a block of its own
+    size_t remainingSize = freeSize - blockSize;
+    if (remainingSize >= MEM_TAG_MIN_BLOCK) {
+        _mem_tag_write(block + blockSize, remainingSize, 0);
+        _mem_tag_push(pool_mgr, block + blockSize);
+    } else {
+        blockSize = freeSize;
+    }
+    _mem_tag_write(block, blockSize, MEM_TAG_ALLOCATED);
+
+    // update metadata (num_allocs, alloc_size)
+    // note: alloc_size counts whole blocks, like the pool inspection
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += blockSize;
+    pool_mgr->total_allocs++;
+    _mem_stats_peak(pool_mgr);
+
+    return block + MEM_TAG_SIZE;
+}
+
+// frees the block that holds the given data pointer, and merges it with
+// the neighbouring blocks that are free
+static alloc_status _mem_tag_del_alloc(pool_mgr_pt pool_mgr, void *alloc) {
+    char *poolStart = pool_mgr->pool.mem;
+    char *poolEnd = poolStart + pool_mgr->pool.total_size;
+
+    // make sure it is the data of an allocated block
+    char *block = _mem_tag_block(pool_mgr, alloc);
+    if (block == NULL) {
+        return ALLOC_FAIL;
+    }
+    size_t size = _mem_tag_size(block);
+
+    // update metadata (num_allocs, alloc_size)
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= size;
+    pool_mgr->total_frees++;
+    _mem_tag_write(block, size, 0);
 
-        pool_mgr->total_nodes = pool_mgr->total_nodes*MEM_NODE_HEAP_EXPAND_FACTOR;
-        free(pool_mgr->node_heap);
-        pool_mgr->node_heap = tempNodeHeap;
+    // if the next block is free, merge it into this one
+    char *next = block + size;
+    if (next < poolEnd && ! _mem_tag_allocated(next)) {
+        _mem_tag_unlink(pool_mgr, next);
+        size += _mem_tag_size(next);
+    }
 
+    // if the previous block is free, merge this one into it
+    if (block > poolStart && ! _mem_tag_allocated(block - MEM_TAG_SIZE)) {
+        char *prev = block - _mem_tag_size(block - MEM_TAG_SIZE);
+        _mem_tag_unlink(pool_mgr, prev);
+        size += _mem_tag_size(prev);
+        block = prev;
     }
 
+    _mem_tag_write(block, size, 0);
+    _mem_tag_push(pool_mgr, block);
+
     return ALLOC_OK;
 }
 
+// resizes the block that holds the given data pointer: shrinks it by
+// splitting off the tail, merged with the next block if that is free; grows
+// it into the next block if that is free and large enough; and otherwise
+// moves the data to a new block
+static void * _mem_tag_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size) {
+    char *block = _mem_tag_block(pool_mgr, alloc);
+    if (block == NULL || size > pool_mgr->pool.total_size) {
+        return NULL;
+    }
+    char *poolEnd = pool_mgr->pool.mem + pool_mgr->pool.total_size;
+    size_t oldSize = _mem_tag_size(block);
+    size_t blockSize = _mem_tag_block_size(size);
+
+    // the free block after this one, if any
+    char *next = block + oldSize;
+    size_t nextSize = (next < poolEnd && ! _mem_tag_allocated(next)) ? _mem_tag_size(next) : 0;
+
+    if (blockSize > oldSize && blockSize - oldSize > nextSize) {
+        // relocate: allocate anew, copy, and deallocate the old
+        char *newAlloc = _mem_tag_new_alloc(pool_mgr, size, 1);
+        if (newAlloc == NULL) {
+            return NULL;
+        }
+        size_t oldData = oldSize - 2 * MEM_TAG_SIZE;
+        memcpy(newAlloc, alloc, (size < oldData) ? size : oldData);
+        _mem_tag_del_alloc(pool_mgr, alloc);
+        return newAlloc;
+    }
+
+    // take the next free block in, and split off what is not needed
+    if (nextSize > 0) {
+        _mem_tag_unlink(pool_mgr, next);
+    }
+    size_t freeSize = oldSize + nextSize;
+    if (freeSize - blockSize >= MEM_TAG_MIN_BLOCK) {
+        _mem_tag_write(block + blockSize, freeSize - blockSize, 0);
+        _mem_tag_push(pool_mgr, block + blockSize);
+    } else {
+        blockSize = freeSize;
+    }
+    _mem_tag_write(block, blockSize, MEM_TAG_ALLOCATED);
+
+    // update metadata (alloc_size)
+    pool_mgr->pool.alloc_size = pool_mgr->pool.alloc_size - oldSize + blockSize;
+    _mem_stats_peak(pool_mgr);
+
+    return alloc;
+}
+
+// returns the block of the given data pointer, or null if it is not the
+// data of an allocated block
+// note: the data of a block can look like a header, so an interior pointer
+// is told apart by the tags around it: the block has to end in a matching
+// footer inside the pool, and the footer in front of it has to lead back
+// to the matching header of the previous block
+static char * _mem_tag_block(pool_mgr_pt pool_mgr, void *alloc) {
+    char *poolStart = pool_mgr->pool.mem;
+    char *poolEnd = poolStart + pool_mgr->pool.total_size;
+    char *mem = alloc;
+    char *block = mem - MEM_TAG_SIZE;
+    if (mem < poolStart + MEM_TAG_SIZE || mem >= poolEnd ||
+        (size_t) (block - poolStart) % MEM_TAG_SIZE != 0 ||
+        ! _mem_tag_allocated(block)) {
+        return NULL;
+    }
+
+    size_t size = _mem_tag_size(block);
+    if (size < MEM_TAG_MIN_BLOCK || size % MEM_TAG_SIZE != 0 ||
+        size > (size_t) (poolEnd - block) ||
+        *(size_t *) (block + size - MEM_TAG_SIZE) != *(size_t *) block) {
+        return NULL;
+    }
+    if (block > poolStart) {
+        size_t prevSize = _mem_tag_size(block - MEM_TAG_SIZE);
+        if (prevSize < MEM_TAG_MIN_BLOCK || prevSize > (size_t) (block - poolStart) ||
+            *(size_t *) (block - prevSize) != *(size_t *) (block - MEM_TAG_SIZE)) {
+            return NULL;
+        }
+    }
+    return block;
+}
+
+// returns the size of the block for the given data size: the data and the
+// tags, rounded up to whole tags, and at least a minimal block
+static size_t _mem_tag_block_size(size_t size) {
+    size_t blockSize = size + 2 * MEM_TAG_SIZE;
+    blockSize += (MEM_TAG_SIZE - blockSize % MEM_TAG_SIZE) % MEM_TAG_SIZE;
+    return (blockSize < MEM_TAG_MIN_BLOCK) ? MEM_TAG_MIN_BLOCK : blockSize;
+}
+
+// reports every block as a segment, in address order
+static void _mem_tag_inspect(pool_mgr_pt pool_mgr,
+                             pool_segment_pt *segments,
+                             unsigned *num_segments) {
+    unsigned numSegments = pool_mgr->pool.num_allocs + pool_mgr->pool.num_gaps;
+    pool_segment_pt segmentArray = calloc(numSegments, sizeof(pool_segment_t));
+    if (segmentArray == NULL){
+        return;
+    }
+
+    char *poolEnd = pool_mgr->pool.mem + pool_mgr->pool.total_size;
+    unsigned s = 0;
+    for (char *block = pool_mgr->pool.mem;
+         block < poolEnd && s < numSegments;
+         block += _mem_tag_size(block)) {
+        segmentArray[s].size = _mem_tag_size(block);
+        segmentArray[s].allocated = (unsigned long) _mem_tag_allocated(block);
+        s++;
+    }
+
+    // "return" the values:
+    *segments = segmentArray;
+    *num_segments = s;
+}
+
+// returns the size of the block with the given header or footer
+static size_t _mem_tag_size(const char *block) {
+    return *(const size_t *) block & ~MEM_TAG_ALLOCATED;
+}
+
+// returns 1 if the block with the given header or footer is allocated
+static int _mem_tag_allocated(const char *block) {
+    return (*(const size_t *) block & MEM_TAG_ALLOCATED) != 0;
+}
+
+// writes the header and footer of the block
+static void _mem_tag_write(char *block, size_t size, size_t allocated) {
+    *(size_t *) block = size | allocated;
+    *(size_t *) (block + size - MEM_TAG_SIZE) = size | allocated;
+}
+
+// returns the free list links (prev, next) of the free block
+static char ** _mem_tag_links(char *block) {
+    return (char **) (block + MEM_TAG_SIZE);
+}
+
+// pushes the free block on the free list of its size class
+static void _mem_tag_push(pool_mgr_pt pool_mgr, char *block) {
+    unsigned c = _mem_size_class(_mem_tag_size(block));
+    char *head = pool_mgr->tag_class_head[c];
+
+    _mem_tag_links(block)[0] = NULL;
+    _mem_tag_links(block)[1] = head;
+    if (head != NULL) {
+        _mem_tag_links(head)[0] = block;
+    }
+    pool_mgr->tag_class_head[c] = block;
+    pool_mgr->gap_class_map |= (uint64_t) 1 << c;
+
+    // update metadata (num_gaps, gap_histogram, largest_gap)
+    pool_mgr->pool.num_gaps++;
+    pool_mgr->gap_histogram[c]++;
+    _mem_largest_gap_add(pool_mgr, _mem_tag_size(block));
+}
+
+// takes the free block off the free list of its size class
+static void _mem_tag_unlink(pool_mgr_pt pool_mgr, char *block) {
+    unsigned c = _mem_size_class(_mem_tag_size(block));
+    char *prev = _mem_tag_links(block)[0];
+    char *next = _mem_tag_links(block)[1];
+
+    if (prev != NULL) {
+        _mem_tag_links(prev)[1] = next;
+    } else {
+        pool_mgr->tag_class_head[c] = next;
+    }
+    if (next != NULL) {
+        _mem_tag_links(next)[0] = prev;
+    }
+    if (pool_mgr->tag_class_head[c] == NULL) {
+        pool_mgr->gap_class_map &= ~((uint64_t) 1 << c);
+    }
+
+    // update metadata (num_gaps, gap_histogram, largest_gap)
+    pool_mgr->pool.num_gaps--;
+    pool_mgr->gap_histogram[c]--;
+    _mem_largest_gap_remove(pool_mgr, _mem_tag_size(block));
+}
+
 static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr) {
     // see above
+    // note: the tree links are gap_ix positions, so realloc keeps them valid
     if(((float)pool_mgr->pool.num_gaps/pool_mgr->gap_ix_capacity)>MEM_GAP_IX_FILL_FACTOR){
-        pool_mgr->gap_ix = realloc(pool_mgr->gap_ix, sizeof(gap_t)*pool_mgr->gap_ix_capacity*MEM_GAP_IX_EXPAND_FACTOR);
+        gap_pt newGapIx = realloc(pool_mgr->gap_ix, sizeof(gap_t)*pool_mgr->gap_ix_capacity*MEM_GAP_IX_EXPAND_FACTOR);
+        if (newGapIx == NULL) {
+            return ALLOC_FAIL;
+        }
+        pool_mgr->gap_ix = newGapIx;
         pool_mgr->gap_ix_capacity = pool_mgr->gap_ix_capacity*MEM_GAP_IX_EXPAND_FACTOR;
     }
     return ALLOC_OK;
@@ -565,9 +5220,16 @@ static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
     //TODO: How to Check Success?
     pool_mgr->gap_ix[pool_mgr->pool.num_gaps].size = size;
     pool_mgr->gap_ix[pool_mgr->pool.num_gaps].node = node;
+    node->gap_ix_pos = pool_mgr->pool.num_gaps;
 
-    // update metadata (num_gaps)
+    // every new or merged gap passes through here, so keep the page map
+    // in step with its boundaries
+    _mem_page_map_set(pool_mgr, node);
+
+    // update metadata (num_gaps, gap_histogram, largest_gap)
     pool_mgr->pool.num_gaps ++;
+    pool_mgr->gap_histogram[_mem_size_class(size)]++;
+    _mem_largest_gap_add(pool_mgr, size);
 
     // sort the gap index (call the function)
     if(_mem_sort_gap_ix(pool_mgr) != ALLOC_OK) {
@@ -581,33 +5243,66 @@ static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
 static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr,
                                             size_t size,
                                             node_pt node) {
-    // find the position of the node in the gap index
-    unsigned found = 0;
-    int gapNodeIndex = 0;
-    for (gapNodeIndex = 0; gapNodeIndex < pool_mgr->pool.num_gaps; ++gapNodeIndex) {
-        if (pool_mgr->gap_ix[gapNodeIndex].node == node) {
-            found = 1;
-            break;
+    // find the entry of the node in the gap index and unlink it from the trees
+    unsigned gapNodeIndex = MEM_GAP_IX_NIL;
+    for (gap_tree tree = 0; tree < GAP_TREE_COUNT; ++tree) {
+        if (_mem_gap_ix_has_tree(pool_mgr, tree)) {
+            pool_mgr->gap_ix_root[tree] =
+                    _mem_gap_ix_unlink(pool_mgr, tree, pool_mgr->gap_ix_root[tree],
+                                       size, node->alloc_record.mem, &gapNodeIndex);
         }
     }
-    if(!found) {
+    if (_mem_gap_ix_has_lists(pool_mgr) &&
+        node->gap_ix_pos < pool_mgr->pool.num_gaps &&
+        pool_mgr->gap_ix[node->gap_ix_pos].node == node) {
+        gapNodeIndex = node->gap_ix_pos;
+        _mem_gap_class_unlink(pool_mgr, gapNodeIndex);
+    }
+    if(gapNodeIndex == MEM_GAP_IX_NIL) {
         return ALLOC_FAIL;
     }
 
-    // loop from there to the end of the array:
-    //    pull the entries (i.e. copy over) one position up
-    //    this effectively deletes the chosen node
-    while(gapNodeIndex < pool_mgr->pool.num_gaps) {
-        pool_mgr->gap_ix[gapNodeIndex].size = pool_mgr->gap_ix[gapNodeIndex+1].size;
-        pool_mgr->gap_ix[gapNodeIndex].node = pool_mgr->gap_ix[gapNodeIndex+1].node;
-        gapNodeIndex++;
+    // update metadata (num_gaps, gap_histogram, largest_gap)
+    pool_mgr->pool.num_gaps--;
+    pool_mgr->gap_histogram[_mem_size_class(pool_mgr->gap_ix[gapNodeIndex].size)]--;
+    _mem_largest_gap_remove(pool_mgr, pool_mgr->gap_ix[gapNodeIndex].size);
+
+    // keep the array packed: move the last entry into the freed position
+    // and point its parents (found by key) to the new position
+    unsigned last = pool_mgr->pool.num_gaps;
+    if (gapNodeIndex != last) {
+        gap_pt moved = &pool_mgr->gap_ix[last];
+        for (gap_tree tree = 0; tree < GAP_TREE_COUNT; ++tree) {
+            if (! _mem_gap_ix_has_tree(pool_mgr, tree)) {
+                continue;
+            }
+            unsigned *link = &pool_mgr->gap_ix_root[tree];
+            while (*link != last) {
+                int cmp = _mem_gap_ix_cmp(pool_mgr, tree, *link, moved->size,
+                                          moved->node->alloc_record.mem);
+                link = (cmp < 0) ? &pool_mgr->gap_ix[*link].link[tree].left
+                                 : &pool_mgr->gap_ix[*link].link[tree].right;
+            }
+            *link = gapNodeIndex;
+        }
+        if (_mem_gap_ix_has_lists(pool_mgr)) {
+            // relink the neighbours (or the class head) in the class list
+            if (moved->class_prev != MEM_GAP_IX_NIL) {
+                pool_mgr->gap_ix[moved->class_prev].class_next = gapNodeIndex;
+            } else {
+                pool_mgr->gap_class_head[_mem_gap_class(pool_mgr, moved->size)] = gapNodeIndex;
+            }
+            if (moved->class_next != MEM_GAP_IX_NIL) {
+                pool_mgr->gap_ix[moved->class_next].class_prev = gapNodeIndex;
+            }
+        }
+        pool_mgr->gap_ix[gapNodeIndex] = *moved;
+        pool_mgr->gap_ix[gapNodeIndex].node->gap_ix_pos = gapNodeIndex;
     }
 
-    // update metadata (num_gaps)
-    pool_mgr->pool.num_gaps--;
     // zero out the element at position num_gaps!
-    pool_mgr->gap_ix[pool_mgr->pool.num_gaps].size = 0;
-    pool_mgr->gap_ix[pool_mgr->pool.num_gaps].node = NULL;
+    pool_mgr->gap_ix[last].size = 0;
+    pool_mgr->gap_ix[last].node = NULL;
     return ALLOC_OK;
 }
 
@@ -616,31 +5311,22 @@ static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr) {
     if(pool_mgr->pool.num_gaps == 0){
         return ALLOC_FAIL;
     }
-    // the new entry is at the end, so "bubble it up"
-    // loop from num_gaps - 1 until but not including 0:
-    for(int i = pool_mgr->pool.num_gaps - 1; i > 0; i--){
-        //    if the size of the current entry is less than the previous (u - 1)
-        //    or if the sizes are the same but the current entry points to a
-        //    node with a lower address of pool allocation address (mem)
-        gap_pt current = &pool_mgr->gap_ix[i];
-        gap_pt previous = &pool_mgr->gap_ix[i-1];
-
-        if
-        (current->size < previous->size ||
-        (current->size == previous->size &&
-         current->node->alloc_record.mem < previous->node->alloc_record.mem))
-        {
-            //   swap them (by copying) (remember to use a temporary variable)
-            gap_t temp;
-            temp.node = current->node;
-            temp.size = current->size;
-
-            current->node = previous->node;
-            current->size = previous->size;
-            previous->node = temp.node;
-            previous->size = temp.size;
+    // the new entry is at the end, so link it into the trees, which keep
+    // the entries in ascending order by size (and by pool address for
+    // entries of the same size), and in ascending order by pool address
+    unsigned newGap = pool_mgr->pool.num_gaps - 1;
+    for (gap_tree tree = 0; tree < GAP_TREE_COUNT; ++tree) {
+        if (_mem_gap_ix_has_tree(pool_mgr, tree)) {
+            pool_mgr->gap_ix[newGap].link[tree].left = MEM_GAP_IX_NIL;
+            pool_mgr->gap_ix[newGap].link[tree].right = MEM_GAP_IX_NIL;
+            _mem_gap_ix_update(pool_mgr, tree, newGap);
+            pool_mgr->gap_ix_root[tree] =
+                    _mem_gap_ix_insert(pool_mgr, tree, pool_mgr->gap_ix_root[tree], newGap);
         }
     }
+    if (_mem_gap_ix_has_lists(pool_mgr)) {
+        _mem_gap_class_push(pool_mgr, newGap);
+    }
 
     return ALLOC_OK;
 }
@@ -651,6 +5337,475 @@ static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr) {
         pool_mgr->gap_ix[i].node = NULL;
     }
     pool_mgr->pool.num_gaps = 0;
+    for (unsigned c = 0; c < MEM_STATS_GAP_CLASSES; ++c) {
+        pool_mgr->gap_histogram[c] = 0;
+    }
+    pool_mgr->gap_ix_root[GAP_TREE_SIZE] = MEM_GAP_IX_NIL;
+    pool_mgr->gap_ix_root[GAP_TREE_ADDR] = MEM_GAP_IX_NIL;
+    for (unsigned c = 0; c < MEM_GAP_CLASS_COUNT * MEM_GAP_SUBCLASS_COUNT; ++c) {
+        pool_mgr->gap_class_head[c] = MEM_GAP_IX_NIL;
+    }
+    for (unsigned c = 0; c < MEM_GAP_CLASS_COUNT; ++c) {
+        pool_mgr->gap_subclass_map[c] = 0;
+    }
+    pool_mgr->gap_class_map = 0;
+    pool_mgr->largest_gap = 0;
+    pool_mgr->largest_gap_exact = 1;
+    pool_mgr->largest_gap_count = 0;
     return ALLOC_OK;
 }
 
+// finds a sufficient gap in the gap index, as per the policy of the pool
+// note: with an alignment, a gap is sufficient if it holds the padding up
+// to the first aligned address, and the size after it; the free lists
+// only know the sizes of their gaps, so they are asked for a gap that
+// holds the size at any alignment
+static unsigned _mem_find_policy_gap_ix(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    size_t classSize = size + (alignment - 1);
+    switch (pool_mgr->pool.policy) {
+        case FIRST_FIT:
+            // the lowest-address sufficient gap
+            return (alignment == 1) ?
+                   _mem_find_first_gap_ix(pool_mgr, size) :
+                   _mem_find_first_aligned_gap_ix(pool_mgr,
+                                                  pool_mgr->gap_ix_root[GAP_TREE_ADDR],
+                                                  size, alignment);
+        case SEGREGATED_FIT:
+            // the most recent gap of the first non-empty sufficient class
+            return _mem_find_class_gap_ix(pool_mgr, classSize);
+        case TLSF:
+            // the most recent gap of the first non-empty sufficient subclass
+            return _mem_find_tlsf_gap_ix(pool_mgr, classSize);
+        default:
+            // BEST_FIT: the smallest sufficient gap
+            return _mem_find_aligned_gap_ix(pool_mgr, size, alignment);
+    }
+}
+
+// returns the smallest gap of at least the given size (lowest address among
+// gaps of equal size), or MEM_GAP_IX_NIL if there is none
+static unsigned _mem_find_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned found = MEM_GAP_IX_NIL;
+    unsigned current = pool_mgr->gap_ix_root[GAP_TREE_SIZE];
+    while (current != MEM_GAP_IX_NIL) {
+        if (pool_mgr->gap_ix[current].size >= size) {
+            found = current;
+            current = pool_mgr->gap_ix[current].link[GAP_TREE_SIZE].left;
+        } else {
+            current = pool_mgr->gap_ix[current].link[GAP_TREE_SIZE].right;
+        }
+    }
+    return found;
+}
+
+// returns the lowest-address gap of at least the given size, or
+// MEM_GAP_IX_NIL if there is none; max_size steers the descent so that
+// only subtrees which contain a sufficient gap are entered
+static unsigned _mem_find_first_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned current = pool_mgr->gap_ix_root[GAP_TREE_ADDR];
+    while (current != MEM_GAP_IX_NIL) {
+        gap_pt entry = &pool_mgr->gap_ix[current];
+        unsigned left = entry->link[GAP_TREE_ADDR].left;
+        unsigned right = entry->link[GAP_TREE_ADDR].right;
+        if (left != MEM_GAP_IX_NIL && pool_mgr->gap_ix[left].max_size >= size) {
+            current = left;
+        } else if (entry->size >= size) {
+            return current;
+        } else if (right != MEM_GAP_IX_NIL && pool_mgr->gap_ix[right].max_size >= size) {
+            current = right;
+        } else {
+            break;
+        }
+    }
+    return MEM_GAP_IX_NIL;
+}
+
+// returns the smallest gap (lowest address among gaps of equal size) that
+// holds the size at the alignment; starting from the smallest gap of the
+// size, takes the next larger one while the padding does not fit, which
+// stops at the latest at a gap that holds the size plus the alignment
+static unsigned _mem_find_aligned_gap_ix(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    unsigned found = _mem_find_gap_ix(pool_mgr, size);
+    while (found != MEM_GAP_IX_NIL && ! _mem_gap_fits(pool_mgr, found, size, alignment)) {
+        size_t foundSize = pool_mgr->gap_ix[found].size;
+        const char *foundMem = pool_mgr->gap_ix[found].node->alloc_record.mem;
+
+        // the next gap in the tree order
+        unsigned next = MEM_GAP_IX_NIL;
+        unsigned current = pool_mgr->gap_ix_root[GAP_TREE_SIZE];
+        while (current != MEM_GAP_IX_NIL) {
+            if (_mem_gap_ix_cmp(pool_mgr, GAP_TREE_SIZE, current, foundSize, foundMem) < 0) {
+                next = current;
+                current = pool_mgr->gap_ix[current].link[GAP_TREE_SIZE].left;
+            } else {
+                current = pool_mgr->gap_ix[current].link[GAP_TREE_SIZE].right;
+            }
+        }
+        found = next;
+    }
+    return found;
+}
+
+// returns the lowest-address gap in the subtree that holds the size at the
+// alignment; max_size skips the subtrees without a gap of the size, and
+// only the gaps of the size that cannot hold the padding are passed over
+static unsigned
+        _mem_find_first_aligned_gap_ix(pool_mgr_pt pool_mgr,
+                                       unsigned gap,
+                                       size_t size,
+                                       size_t alignment) {
+    if (gap == MEM_GAP_IX_NIL || pool_mgr->gap_ix[gap].max_size < size) {
+        return MEM_GAP_IX_NIL;
+    }
+    unsigned found = _mem_find_first_aligned_gap_ix(pool_mgr,
+                                                    pool_mgr->gap_ix[gap].link[GAP_TREE_ADDR].left,
+                                                    size, alignment);
+    if (found != MEM_GAP_IX_NIL) {
+        return found;
+    }
+    if (_mem_gap_fits(pool_mgr, gap, size, alignment)) {
+        return gap;
+    }
+    return _mem_find_first_aligned_gap_ix(pool_mgr,
+                                          pool_mgr->gap_ix[gap].link[GAP_TREE_ADDR].right,
+                                          size, alignment);
+}
+
+// returns the number of bytes from the address up to the next aligned one
+static size_t _mem_align_padding(const char *mem, size_t alignment) {
+    return (size_t) (-(uintptr_t) mem & (alignment - 1));
+}
+
+// returns the log2 of the alignment, a power of two
+static unsigned _mem_align_shift(size_t alignment) {
+    unsigned shift = 0;
+    while (((size_t) 1 << shift) < alignment) {
+        shift++;
+    }
+    return shift;
+}
+
+// returns 1 if the gap holds the padding up to its first aligned address,
+// and the size after it
+static int _mem_gap_fits(pool_mgr_pt pool_mgr, unsigned gap, size_t size, size_t alignment) {
+    size_t gapSize = pool_mgr->gap_ix[gap].size;
+    size_t padding = _mem_align_padding(pool_mgr->gap_ix[gap].node->alloc_record.mem, alignment);
+    return gapSize >= size && gapSize - size >= padding;
+}
+
+// returns a gap of at least the given size from the size class free lists:
+// every gap in the classes above the size's own class is sufficient, so the
+// lowest non-empty one is found in the class bitmap; only when there is none
+// is the size's own class searched
+static unsigned _mem_find_class_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned sizeClass = _mem_size_class(size);
+    unsigned fitClass = ((size & (size - 1)) == 0) ? sizeClass : sizeClass + 1;
+
+    uint64_t fitMap = (fitClass < MEM_GAP_CLASS_COUNT) ?
+                      pool_mgr->gap_class_map & (~(uint64_t) 0 << fitClass) : 0;
+    if (fitMap != 0) {
+        unsigned c = _mem_lowest_bit(fitMap);
+        return pool_mgr->gap_class_head[c * MEM_GAP_SUBCLASS_COUNT];
+    }
+
+    unsigned current = pool_mgr->gap_class_head[sizeClass * MEM_GAP_SUBCLASS_COUNT];
+    while (current != MEM_GAP_IX_NIL && pool_mgr->gap_ix[current].size < size) {
+        current = pool_mgr->gap_ix[current].class_next;
+    }
+    return current;
+}
+
+// returns a gap of at least the given size from the TLSF free lists in
+// constant time: the size is rounded up to the next subclass boundary, so
+// that every gap in that subclass and above is sufficient, and the lowest
+// non-empty one is found with two bitmap lookups; failing that, only the
+// head of the size's own subclass is tried, so the search stays bounded
+static unsigned _mem_find_tlsf_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    size_t fitSize = size;
+    if (size >= MEM_GAP_SUBCLASS_COUNT) {
+        size_t round = ((size_t) 1 << (_mem_size_class(size) - MEM_GAP_SUBCLASS_LOG2)) - 1;
+        if (size + round > size) {
+            fitSize = size + round;
+        }
+    }
+    unsigned fit = _mem_gap_class(pool_mgr, fitSize);
+    unsigned fl = fit / MEM_GAP_SUBCLASS_COUNT;
+    unsigned sl = fit % MEM_GAP_SUBCLASS_COUNT;
+
+    uint64_t slMap = pool_mgr->gap_subclass_map[fl] & (~(uint64_t) 0 << sl);
+    if (slMap == 0) {
+        uint64_t flMap = (fl + 1 < MEM_GAP_CLASS_COUNT) ?
+                         pool_mgr->gap_class_map & (~(uint64_t) 0 << (fl + 1)) : 0;
+        if (flMap != 0) {
+            fl = _mem_lowest_bit(flMap);
+            slMap = pool_mgr->gap_subclass_map[fl];
+        }
+    }
+    if (slMap != 0) {
+        return pool_mgr->gap_class_head[fl * MEM_GAP_SUBCLASS_COUNT + _mem_lowest_bit(slMap)];
+    }
+
+    unsigned head = pool_mgr->gap_class_head[_mem_gap_class(pool_mgr, size)];
+    if (head != MEM_GAP_IX_NIL && pool_mgr->gap_ix[head].size >= size) {
+        return head;
+    }
+    return MEM_GAP_IX_NIL;
+}
+
+// each policy only searches one of the trees, so only that one is kept
+static int _mem_gap_ix_has_tree(pool_mgr_pt pool_mgr, gap_tree tree) {
+    if (tree == GAP_TREE_ADDR) {
+        return pool_mgr->pool.policy == FIRST_FIT;
+    }
+    return pool_mgr->pool.policy == BEST_FIT;
+}
+
+// the size class policies keep the size class free lists instead
+static int _mem_gap_ix_has_lists(pool_mgr_pt pool_mgr) {
+    return pool_mgr->pool.policy == SEGREGATED_FIT ||
+           pool_mgr->pool.policy == TLSF ||
+           pool_mgr->pool.policy == BUDDY;
+}
+
+// compares the (size, mem) key with the key of the given gap entry;
+// the GAP_TREE_ADDR tree only compares the pool address (mem)
+static int _mem_gap_ix_cmp(pool_mgr_pt pool_mgr,
+                           gap_tree tree,
+                           unsigned gap,
+                           size_t size,
+                           const char *mem) {
+    gap_pt entry = &pool_mgr->gap_ix[gap];
+    if (tree == GAP_TREE_SIZE && size != entry->size) {
+        return (size < entry->size) ? -1 : 1;
+    }
+    if (mem != entry->node->alloc_record.mem) {
+        return (mem < entry->node->alloc_record.mem) ? -1 : 1;
+    }
+    return 0;
+}
+
+static unsigned _mem_gap_ix_height(pool_mgr_pt pool_mgr, gap_tree tree, unsigned gap) {
+    return (gap == MEM_GAP_IX_NIL) ? 0 : pool_mgr->gap_ix[gap].link[tree].height;
+}
+
+// recomputes the height (and max_size) of an entry from its children
+static void _mem_gap_ix_update(pool_mgr_pt pool_mgr, gap_tree tree, unsigned gap) {
+    gap_pt entry = &pool_mgr->gap_ix[gap];
+    unsigned left = entry->link[tree].left;
+    unsigned right = entry->link[tree].right;
+    unsigned lh = _mem_gap_ix_height(pool_mgr, tree, left);
+    unsigned rh = _mem_gap_ix_height(pool_mgr, tree, right);
+    entry->link[tree].height = 1 + (lh > rh ? lh : rh);
+
+    if (tree == GAP_TREE_ADDR) {
+        entry->max_size = entry->size;
+        if (left != MEM_GAP_IX_NIL && pool_mgr->gap_ix[left].max_size > entry->max_size) {
+            entry->max_size = pool_mgr->gap_ix[left].max_size;
+        }
+        if (right != MEM_GAP_IX_NIL && pool_mgr->gap_ix[right].max_size > entry->max_size) {
+            entry->max_size = pool_mgr->gap_ix[right].max_size;
+        }
+    }
+}
+
+// rotates the subtree left (or right) and returns its new root
+static unsigned _mem_gap_ix_rotate(pool_mgr_pt pool_mgr,
+                                   gap_tree tree,
+                                   unsigned gap,
+                                   int left) {
+    gap_link_t *top = &pool_mgr->gap_ix[gap].link[tree];
+    unsigned pivot = left ? top->right : top->left;
+    gap_link_t *pivotLink = &pool_mgr->gap_ix[pivot].link[tree];
+
+    if (left) {
+        top->right = pivotLink->left;
+        pivotLink->left = gap;
+    } else {
+        top->left = pivotLink->right;
+        pivotLink->right = gap;
+    }
+
+    _mem_gap_ix_update(pool_mgr, tree, gap);
+    _mem_gap_ix_update(pool_mgr, tree, pivot);
+
+    return pivot;
+}
+
+// restores the AVL property at the given entry and returns the subtree root
+static unsigned _mem_gap_ix_balance(pool_mgr_pt pool_mgr, gap_tree tree, unsigned gap) {
+    gap_link_t *entry = &pool_mgr->gap_ix[gap].link[tree];
+    unsigned lh = _mem_gap_ix_height(pool_mgr, tree, entry->left);
+    unsigned rh = _mem_gap_ix_height(pool_mgr, tree, entry->right);
+
+    if (lh > rh + 1) {
+        gap_link_t *child = &pool_mgr->gap_ix[entry->left].link[tree];
+        if (_mem_gap_ix_height(pool_mgr, tree, child->right) >
+            _mem_gap_ix_height(pool_mgr, tree, child->left)) {
+            entry->left = _mem_gap_ix_rotate(pool_mgr, tree, entry->left, 1);
+        }
+        return _mem_gap_ix_rotate(pool_mgr, tree, gap, 0);
+    }
+    if (rh > lh + 1) {
+        gap_link_t *child = &pool_mgr->gap_ix[entry->right].link[tree];
+        if (_mem_gap_ix_height(pool_mgr, tree, child->left) >
+            _mem_gap_ix_height(pool_mgr, tree, child->right)) {
+            entry->right = _mem_gap_ix_rotate(pool_mgr, tree, entry->right, 0);
+        }
+        return _mem_gap_ix_rotate(pool_mgr, tree, gap, 1);
+    }
+
+    _mem_gap_ix_update(pool_mgr, tree, gap);
+    return gap;
+}
+
+static unsigned _mem_gap_ix_insert(pool_mgr_pt pool_mgr,
+                                   gap_tree tree,
+                                   unsigned root,
+                                   unsigned gap) {
+    if (root == MEM_GAP_IX_NIL) {
+        return gap;
+    }
+    gap_pt entry = &pool_mgr->gap_ix[gap];
+    gap_link_t *rootLink = &pool_mgr->gap_ix[root].link[tree];
+    if (_mem_gap_ix_cmp(pool_mgr, tree, root, entry->size, entry->node->alloc_record.mem) < 0) {
+        rootLink->left = _mem_gap_ix_insert(pool_mgr, tree, rootLink->left, gap);
+    } else {
+        rootLink->right = _mem_gap_ix_insert(pool_mgr, tree, rootLink->right, gap);
+    }
+    return _mem_gap_ix_balance(pool_mgr, tree, root);
+}
+
+// unlinks the leftmost entry of the subtree into *min, returns the new root
+static unsigned _mem_gap_ix_unlink_min(pool_mgr_pt pool_mgr,
+                                       gap_tree tree,
+                                       unsigned root,
+                                       unsigned *min) {
+    gap_link_t *rootLink = &pool_mgr->gap_ix[root].link[tree];
+    if (rootLink->left == MEM_GAP_IX_NIL) {
+        *min = root;
+        return rootLink->right;
+    }
+    rootLink->left = _mem_gap_ix_unlink_min(pool_mgr, tree, rootLink->left, min);
+    return _mem_gap_ix_balance(pool_mgr, tree, root);
+}
+
+// unlinks the entry with the given key into *gap, returns the new root
+static unsigned _mem_gap_ix_unlink(pool_mgr_pt pool_mgr,
+                                   gap_tree tree,
+                                   unsigned root,
+                                   size_t size,
+                                   const char *mem,
+                                   unsigned *gap) {
+    if (root == MEM_GAP_IX_NIL) {
+        return MEM_GAP_IX_NIL;
+    }
+    gap_link_t *rootLink = &pool_mgr->gap_ix[root].link[tree];
+    int cmp = _mem_gap_ix_cmp(pool_mgr, tree, root, size, mem);
+    if (cmp < 0) {
+        rootLink->left = _mem_gap_ix_unlink(pool_mgr, tree, rootLink->left, size, mem, gap);
+    } else if (cmp > 0) {
+        rootLink->right = _mem_gap_ix_unlink(pool_mgr, tree, rootLink->right, size, mem, gap);
+    } else {
+        *gap = root;
+        if (rootLink->left == MEM_GAP_IX_NIL || rootLink->right == MEM_GAP_IX_NIL) {
+            return (rootLink->left == MEM_GAP_IX_NIL) ? rootLink->right : rootLink->left;
+        }
+        // replace the entry with its in-order successor
+        unsigned successor = MEM_GAP_IX_NIL;
+        unsigned right = _mem_gap_ix_unlink_min(pool_mgr, tree, rootLink->right, &successor);
+        pool_mgr->gap_ix[successor].link[tree].left = rootLink->left;
+        pool_mgr->gap_ix[successor].link[tree].right = right;
+        return _mem_gap_ix_balance(pool_mgr, tree, successor);
+    }
+    return _mem_gap_ix_balance(pool_mgr, tree, root);
+}
+
+// the size class of a gap is the position of the highest bit of its size,
+// so class c holds the sizes [2^c, 2^(c+1))
+static unsigned _mem_size_class(size_t size) {
+    if (size <= 1) {
+        return 0;
+    }
+#if defined(__GNUC__)
+    return (unsigned) (63 - __builtin_clzll((unsigned long long) size));
+#else
+    unsigned c = 0;
+    while (size >>= 1) c++;
+    return c;
+#endif
+}
+
+// returns the free list of the given gap size, as class * MEM_GAP_SUBCLASS_COUNT
+// + subclass: SEGREGATED_FIT only uses subclass 0; TLSF splits each class
+// into MEM_GAP_SUBCLASS_COUNT linear subclasses by the bits following the
+// highest one, and keeps the sizes below MEM_GAP_SUBCLASS_COUNT in class 0
+static unsigned _mem_gap_class(pool_mgr_pt pool_mgr, size_t size) {
+    if (pool_mgr->pool.policy != TLSF) {
+        return _mem_size_class(size) * MEM_GAP_SUBCLASS_COUNT;
+    }
+    if (size < MEM_GAP_SUBCLASS_COUNT) {
+        return (unsigned) size;
+    }
+    unsigned c = _mem_size_class(size);
+    unsigned sl = (unsigned) (size >> (c - MEM_GAP_SUBCLASS_LOG2)) - MEM_GAP_SUBCLASS_COUNT;
+    return (c - MEM_GAP_SUBCLASS_LOG2 + 1) * MEM_GAP_SUBCLASS_COUNT + sl;
+}
+
+// position of the lowest set bit (find-first-set), bits must not be 0
+static unsigned _mem_lowest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctzll(bits);
+#else
+    unsigned c = 0;
+    while (! (bits & 1)) { bits >>= 1; c++; }
+    return c;
+#endif
+}
+
+// position of the highest set bit, bits must not be 0
+static unsigned _mem_highest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+    return (unsigned) (63 - __builtin_clzll(bits));
+#else
+    unsigned c = 0;
+    while (bits >>= 1) c++;
+    return c;
+#endif
+}
+
+// pushes the gap entry at the head of its size class list
+static void _mem_gap_class_push(pool_mgr_pt pool_mgr, unsigned gap) {
+    unsigned c = _mem_gap_class(pool_mgr, pool_mgr->gap_ix[gap].size);
+    unsigned head = pool_mgr->gap_class_head[c];
+
+    pool_mgr->gap_ix[gap].class_prev = MEM_GAP_IX_NIL;
+    pool_mgr->gap_ix[gap].class_next = head;
+    if (head != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[head].class_prev = gap;
+    }
+    pool_mgr->gap_class_head[c] = gap;
+    pool_mgr->gap_subclass_map[c / MEM_GAP_SUBCLASS_COUNT] |= (uint32_t) 1 << (c % MEM_GAP_SUBCLASS_COUNT);
+    pool_mgr->gap_class_map |= (uint64_t) 1 << (c / MEM_GAP_SUBCLASS_COUNT);
+}
+
+// unlinks the gap entry from its size class list
+static void _mem_gap_class_unlink(pool_mgr_pt pool_mgr, unsigned gap) {
+    gap_pt entry = &pool_mgr->gap_ix[gap];
+    unsigned c = _mem_gap_class(pool_mgr, entry->size);
+
+    if (entry->class_prev != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[entry->class_prev].class_next = entry->class_next;
+    } else {
+        pool_mgr->gap_class_head[c] = entry->class_next;
+    }
+    if (entry->class_next != MEM_GAP_IX_NIL) {
+        pool_mgr->gap_ix[entry->class_next].class_prev = entry->class_prev;
+    }
+    if (pool_mgr->gap_class_head[c] == MEM_GAP_IX_NIL) {
+        unsigned fl = c / MEM_GAP_SUBCLASS_COUNT;
+        pool_mgr->gap_subclass_map[fl] &= ~((uint32_t) 1 << (c % MEM_GAP_SUBCLASS_COUNT));
+        if (pool_mgr->gap_subclass_map[fl] == 0) {
+            pool_mgr->gap_class_map &= ~((uint64_t) 1 << fl);
+        }
+    }
+}
@@ -5,9 +5,15 @@
 #ifndef MEM_POOL_H
 #define MEM_POOL_H
 
+/* constants */
+
+#define MEM_ALIGN_CACHE_LINE 64
+#define MEM_ALIGN_PAGE 4096
+#define MEM_STATS_GAP_CLASSES 64
+
 /* type declarations */
 
-typedef enum _alloc_policy { FIRST_FIT, BEST_FIT } alloc_policy;
+typedef enum _alloc_policy { FIRST_FIT, BEST_FIT, SEGREGATED_FIT, TLSF, BUDDY, SLAB, ARENA, BOUNDARY_TAG } alloc_policy;
 
 typedef struct _pool {
     char *mem;
@@ -23,11 +29,26 @@ typedef struct _pool_segment {
     unsigned long allocated; // 1-allocation, 0-gap (note: 8 bytes)
 } pool_segment_t, *pool_segment_pt;
 
+typedef struct _pool_stats {
+    size_t largest_gap;
+    float fragmentation; // share of the free memory outside the largest gap
+    unsigned gap_histogram[MEM_STATS_GAP_CLASSES]; // gaps of [2^c, 2^(c+1)) bytes
+    size_t peak_alloc_size;
+    unsigned peak_used_nodes;
+    size_t total_allocs;
+    size_t total_frees;
+    size_t total_failures;
+    size_t remote_failures; // queued deallocations that failed when drained
+    unsigned cached_blocks; // counted in num_allocs, but held in a thread cache or quick list
+    size_t cached_size;     // counted in alloc_size, but held in a thread cache or quick list
+} pool_stats_t, *pool_stats_pt;
+
 typedef enum _alloc_status {
     ALLOC_OK,
     ALLOC_FAIL,
     ALLOC_CALLED_AGAIN,
-    ALLOC_NOT_FREED
+    ALLOC_NOT_FREED,
+    ALLOC_PARTIAL
 } alloc_status;
 
 /* function declarations */
@@ -41,15 +62,78 @@ mem_free();
 pool_pt
 mem_pool_open(size_t size, alloc_policy policy);
 
+pool_pt
+mem_slab_open(size_t object_size, unsigned count);
+
+pool_pt
+mem_pool_open_growable(size_t size, alloc_policy policy);
+
+pool_pt
+mem_pool_open_sharded(size_t size, alloc_policy policy, unsigned num_shards);
+
+alloc_status
+mem_pool_set_thread_cache(pool_pt pool, unsigned capacity);
+
+alloc_status
+mem_pool_thread_cache_stats(pool_pt pool, size_t *hits, size_t *misses);
+
+alloc_status
+mem_pool_set_owner(pool_pt pool);
+
+alloc_status
+mem_pool_set_deferred_free(pool_pt pool, unsigned enable);
+
+alloc_status
+mem_pool_maintain(pool_pt pool);
+
+alloc_status
+mem_pool_set_quick_lists(pool_pt pool, unsigned capacity);
+
+alloc_status
+mem_pool_set_auto_compact(pool_pt pool, float threshold, size_t budget);
+
+alloc_status
+mem_pool_compact(pool_pt pool, size_t budget);
+
+alloc_status
+mem_pool_stats(pool_pt pool, pool_stats_pt stats);
+
 alloc_status
 mem_pool_close(pool_pt pool);
 
+alloc_status
+mem_pool_reset(pool_pt pool);
+
 void *
 mem_new_alloc(pool_pt pool, size_t size);
 
+void *
+mem_new_alloc_aligned(pool_pt pool, size_t size, size_t alignment);
+
+unsigned
+mem_new_alloc_batch(pool_pt pool, const size_t *sizes, unsigned n, void **allocs);
+
 alloc_status
 mem_del_alloc(pool_pt pool, void *alloc);
 
+alloc_status
+mem_del_alloc_batch(pool_pt pool, void **allocs, unsigned n);
+
+void *
+mem_realloc(pool_pt pool, void *alloc, size_t size);
+
+size_t
+mem_alloc_size(pool_pt pool, void *alloc);
+
+alloc_status
+mem_pin_alloc(pool_pt pool, void *alloc);
+
+alloc_status
+mem_unpin_alloc(pool_pt pool, void *alloc);
+
 void
 mem_inspect_pool(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments);
+
+alloc_status
+mem_inspect_pool_snapshot(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments);
 #endif //C_MEM_POOL_H
@@ -0,0 +1,223 @@
+//
+// Latency benchmark for the allocation policies.
+//
+// For a growing number of segments, fragments a pool into roughly as many
+// gaps as allocations, and then times single mem_new_alloc/mem_del_alloc
+// calls in a steady-state churn. Prints the latency percentiles per policy,
+// so that it is easy to see which policies stay flat as the pool grows.
+//
+// usage: msl-clang-003-bench [max_segments] [ops_per_run]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mem_pool.h"
+
+
+/*****            constants            *****/
+
+static const unsigned   BENCH_MIN_SEGMENTS      = 1000;
+static const unsigned   BENCH_MAX_SEGMENTS      = 1000000;
+static const unsigned   BENCH_OPS               = 200000;
+static const unsigned   BENCH_MIN_ALLOC         = 16;
+static const unsigned   BENCH_MAX_ALLOC         = 256;
+
+
+/*****         helper routines         *****/
+
+// a small deterministic generator, so every policy sees the same workload
+static unsigned long bench_seed = 1;
+
+static unsigned bench_rand() {
+    bench_seed = bench_seed * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned) (bench_seed >> 33);
+}
+
+static size_t bench_size() {
+    return BENCH_MIN_ALLOC + bench_rand() % (BENCH_MAX_ALLOC - BENCH_MIN_ALLOC + 1);
+}
+
+static long long bench_now_ns() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    unsigned x = *(const unsigned *) a, y = *(const unsigned *) b;
+    return (x > y) - (x < y);
+}
+
+static unsigned bench_percentile(unsigned *lat, unsigned n, double p) {
+    unsigned ix = (unsigned) (p * (n - 1));
+    return lat[ix];
+}
+
+static const char *bench_policy_name(alloc_policy policy) {
+    switch (policy) {
+        case FIRST_FIT:         return "FIRST_FIT";
+        case BEST_FIT:          return "BEST_FIT";
+        case SEGREGATED_FIT:    return "SEGREGATED_FIT";
+        case TLSF:              return "TLSF";
+        case BUDDY:             return "BUDDY";
+        case SLAB:              return "SLAB";
+        case ARENA:             return "ARENA";
+        case BOUNDARY_TAG:      return "BOUNDARY_TAG";
+    }
+    return "?";
+}
+
+// runs one (policy, segments) configuration, returns 0 on success
+static int bench_run(alloc_policy policy, unsigned segments, unsigned ops) {
+    // half of the segments are allocations, half are the gaps between them
+    unsigned num_allocs = segments / 2;
+    size_t pool_size = (size_t) segments * BENCH_MAX_ALLOC * 2;
+    if (policy == BUDDY) {
+        // buddy pools are a power of two
+        size_t buddy_size = 1;
+        while (buddy_size < pool_size) {
+            buddy_size <<= 1;
+        }
+        pool_size = buddy_size;
+    }
+
+    void **allocs = calloc(2 * num_allocs, sizeof(void *));
+    unsigned *alloc_lat = malloc(ops * sizeof(unsigned));
+    unsigned *free_lat = malloc(ops * sizeof(unsigned));
+    if (allocs == NULL || alloc_lat == NULL || free_lat == NULL) {
+        free(allocs); free(alloc_lat); free(free_lat);
+        return 1;
+    }
+
+    pool_pt pool = mem_pool_open(pool_size, policy);
+    if (pool == NULL) {
+        free(allocs); free(alloc_lat); free(free_lat);
+        return 1;
+    }
+
+    // fragment the pool: allocate twice as many blocks, free every other
+    // note: on a failure, whatever is still allocated is freed below, so
+    // that the pool can be closed
+    int status = 0;
+    unsigned live = 2 * num_allocs;
+    bench_seed = segments;
+    for (unsigned i = 0; i < 2 * num_allocs; ++i) {
+        allocs[i] = mem_new_alloc(pool, bench_size());
+        if (allocs[i] == NULL) {
+            fprintf(stderr, "setup allocation %u failed\n", i);
+            live = i;
+            status = 1;
+            break;
+        }
+    }
+    unsigned kept = 0;
+    for (unsigned i = 0; i < live; ++i) {
+        if (i % 2 == 0) {
+            allocs[kept++] = allocs[i];
+        } else if (mem_del_alloc(pool, allocs[i]) != ALLOC_OK) {
+            fprintf(stderr, "setup deallocation %u failed\n", i);
+            allocs[kept++] = allocs[i];
+            status = 1;
+        }
+    }
+    live = kept;
+
+    // steady-state churn: free a random allocation, allocate a random size
+    for (unsigned op = 0; status == 0 && op < ops; ++op) {
+        unsigned victim = bench_rand() % live;
+        size_t size = bench_size();
+
+        long long t0 = bench_now_ns();
+        alloc_status freed = mem_del_alloc(pool, allocs[victim]);
+        long long t1 = bench_now_ns();
+        if (freed != ALLOC_OK) {
+            fprintf(stderr, "deallocation failed at op %u\n", op);
+            status = 1;
+            break;
+        }
+        allocs[victim] = mem_new_alloc(pool, size);
+        long long t2 = bench_now_ns();
+
+        if (allocs[victim] == NULL) {
+            fprintf(stderr, "allocation failed at op %u\n", op);
+            status = 1;
+            break;
+        }
+        free_lat[op] = (unsigned) (t1 - t0);
+        alloc_lat[op] = (unsigned) (t2 - t1);
+    }
+
+    unsigned gaps = pool->num_gaps;
+
+    // clean up
+    for (unsigned i = 0; i < live; ++i) {
+        if (allocs[i] != NULL && mem_del_alloc(pool, allocs[i]) != ALLOC_OK) {
+            fprintf(stderr, "deallocation %u failed\n", i);
+            status = 1;
+        }
+    }
+    if (mem_pool_close(pool) != ALLOC_OK) {
+        fprintf(stderr, "pool not closed\n");
+        status = 1;
+    }
+    if (status != 0) {
+        free(allocs); free(alloc_lat); free(free_lat);
+        return status;
+    }
+
+    qsort(alloc_lat, ops, sizeof(unsigned), bench_cmp);
+    qsort(free_lat, ops, sizeof(unsigned), bench_cmp);
+    printf("%-15s %9u %8u | %7u %7u %8u %9u | %7u %7u %8u %9u\n",
+           bench_policy_name(policy), segments, gaps,
+           bench_percentile(alloc_lat, ops, 0.5),
+           bench_percentile(alloc_lat, ops, 0.99),
+           bench_percentile(alloc_lat, ops, 0.999),
+           alloc_lat[ops - 1],
+           bench_percentile(free_lat, ops, 0.5),
+           bench_percentile(free_lat, ops, 0.99),
+           bench_percentile(free_lat, ops, 0.999),
+           free_lat[ops - 1]);
+    fflush(stdout);
+
+    free(allocs);
+    free(alloc_lat);
+    free(free_lat);
+    return 0;
+}
+
+
+/*****              main               *****/
+
+int main(int argc, char *argv[]) {
+    unsigned max_segments = (argc > 1) ? (unsigned) strtoul(argv[1], NULL, 10) : BENCH_MAX_SEGMENTS;
+    unsigned ops = (argc > 2) ? (unsigned) strtoul(argv[2], NULL, 10) : BENCH_OPS;
+    const alloc_policy policies[] = { FIRST_FIT, BEST_FIT, SEGREGATED_FIT, TLSF, BUDDY, BOUNDARY_TAG };
+
+    if (mem_init() != ALLOC_OK) {
+        return 1;
+    }
+
+    printf("%-15s %9s %8s | %7s %7s %8s %9s | %7s %7s %8s %9s\n",
+           "policy", "segments", "gaps",
+           "a.p50", "a.p99", "a.p99.9", "a.max",
+           "f.p50", "f.p99", "f.p99.9", "f.max");
+    printf("%-15s %9s %8s | %34s | %34s\n", "", "", "", "alloc latency (ns)", "free latency (ns)");
+
+    int status = 0;
+    for (unsigned p = 0; status == 0 && p < sizeof(policies) / sizeof(policies[0]); ++p) {
+        for (unsigned segments = BENCH_MIN_SEGMENTS;
+             status == 0 && segments <= max_segments;
+             segments *= 10) {
+            status = bench_run(policies[p], segments, ops);
+        }
+    }
+
+    // note: every run closes its pool, even when it fails
+    if (mem_free() != ALLOC_OK) {
+        fprintf(stderr, "pool store not freed\n");
+        status = 1;
+    }
+    return status;
+}
@@ -4,6 +4,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef MEM_POOL_THREAD_SAFE
+#include <pthread.h>
+#endif
 
 #include <stdarg.h>
 #include <stddef.h>
@@ -2314,123 +2319,2701 @@ static void test_pool_scenario19(void **state) {
 }
 
 /*******************************************/
-/***        5. STRESS TESTING            ***/
+/***     5. SEGREGATED_FIT SCENARIOS     ***/
 /*******************************************/
 
-void test_pool_stresstest0(void **state) {
-    (void) state; /* unused */
+static int pool_sf_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = SEGREGATED_FIT;
+    pool_pt pool = NULL;
 
-    const unsigned num_pools = 200;
-    const unsigned num_allocations = 1000;
-    const unsigned min_alloc_size = 10;
-    const unsigned pool_size =
-            (num_allocations / 2) *
-            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
-    assert_int_equal(pool_size, 5005000);
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "SEGREGATED_FIT");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
 
+    *state = pool;
 
-    pool_pt pools[num_pools];
-    void *allocations[num_pools][num_allocations];
+    return 0;
+}
+
+static int pool_sf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario20(void **state) {
+    pool_pt pool = *state;
 
     /*
-     * Testing dynamic reallocation of pool structures:
+     * Scenario 20:
      *
-     * 1. 200 pools of 5005000 each (many pools)
-     * 2. In each pool 1000 allocations of different sizes (many allocations)
-     * 3. In each pool 500 deallocations (many gaps)
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 x 100.
+     * 3. Deallocate (2, 1, 3), (6, 5), 8
+     * 4. Allocate 150. Goes to the 300 gap, the only one in [256, 512).
+     * 5. Allocate 50. Goes to the 100 gap, the only one in [64, 128).
+     * 6. Clean up.
      */
 
-    // initialize store
-    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, SEGREGATED_FIT, POOL_SIZE, 0, 0, 1);
 
-    // allocate pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // open pool
-        pools[pix] =
-                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
-        assert_non_null(pools[pix]);
-        // allocate pool
-        unsigned allocated = 0;
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            allocations[pix][aix] =
-                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
-            allocated += (aix + 1) * min_alloc_size;
-            if (!allocations[pix][aix]) {
-                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
-            }
-            assert_non_null(allocations[pix][aix]);
-        }
 
-        // delete every other allocation
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (aix % 2) {
-                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-                allocations[pix][aix] = NULL;
-            }
-        }
+    const unsigned NUM_ALLOCS = 10;
+
+    void * *allocs = (void * *) calloc(NUM_ALLOCS, sizeof(void *));
+    assert_non_null(allocs);
+
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
     }
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK); allocs[2]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK); allocs[1]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK); allocs[3]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[6]), ALLOC_OK); allocs[6]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[5]), ALLOC_OK); allocs[5]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[8]), ALLOC_OK); allocs[8]=0;
 
-    // delete pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // delete pool's allocations
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (allocations[pix][aix]) {
-                // delete allocation
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-            }
-        }
-        // close pool
-        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
+    pool_segment_t exp1[8] =
+            {
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp1);
+
+
+    void * alloc0 = mem_new_alloc(pool, 150);
+    assert_non_null(alloc0);
+    pool_segment_t exp2[9] =
+            {
+                    {100, 1},
+                    {150, 1},
+                    {150, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp2);
+
+
+    void * alloc1 = mem_new_alloc(pool, 50);
+    assert_non_null(alloc1);
+    pool_segment_t exp3[10] =
+            {
+                    {100, 1},
+                    {150, 1},
+                    {150, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {50, 1},
+                    {50, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, SEGREGATED_FIT, POOL_SIZE, 600, 6, 4);
+
+
+    // clean up
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
     }
+    free(allocs);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
 
-    // free store
-    assert_int_equal(mem_free(), ALLOC_OK);
-}
 
+    check_pool(pool, exp0);
+}
 
 /*******************************************/
-/***         6. DRIVER ROUTINE           ***/
+/***          6. TLSF SCENARIOS          ***/
 /*******************************************/
 
-int run_test_suite() {
-    const struct CMUnitTest tests[] = {
-            // General tests
-            cmocka_unit_test(test_pool_store_smoketest),
-            cmocka_unit_test(test_pool_smoketest),
+static int pool_tlsf_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = TLSF;
+    pool_pt pool = NULL;
 
-            cmocka_unit_test(test_pool_nonempty),
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
 
-            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "TLSF");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
 
-            // First-fit tests
-            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+    *state = pool;
 
-            // Best-fit tests
-            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+    return 0;
+}
+
+static int pool_tlsf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario21(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 21:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 x 100.
+     * 3. Deallocate (2, 1, 3), (6, 5), 8
+     * 4. Allocate 150. Rounded up to [152, 160), the first non-empty
+     *    subclass at or above it holds the 200 gap.
+     * 5. Allocate 50. Rounded up to [50, 52), which holds the 50 gap
+     *    left over from the 200 gap.
+     * 6. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, TLSF, POOL_SIZE, 0, 0, 1);
+
+
+    const unsigned NUM_ALLOCS = 10;
+
+    void * *allocs = (void * *) calloc(NUM_ALLOCS, sizeof(void *));
+    assert_non_null(allocs);
+
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK); allocs[2]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK); allocs[1]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK); allocs[3]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[6]), ALLOC_OK); allocs[6]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[5]), ALLOC_OK); allocs[5]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[8]), ALLOC_OK); allocs[8]=0;
+
+
+    void * alloc0 = mem_new_alloc(pool, 150);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 50);
+    assert_non_null(alloc1);
+    pool_segment_t exp1[9] =
+            {
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {150, 1},
+                    {50, 1},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF, POOL_SIZE, 600, 6, 3);
+
+
+    // clean up
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    free(allocs);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***          7. BUDDY SCENARIOS         ***/
+/*******************************************/
+
+static const size_t BUDDY_POOL_SIZE = 1 << 20;
+
+static int pool_buddy_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = BUDDY;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) BUDDY_POOL_SIZE, "BUDDY");
+    pool = mem_pool_open(BUDDY_POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_buddy_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario22(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 22:
+     *
+     * 1. Pool starts out as a single gap. A pool size that is not a
+     *    power of two is refused.
+     * 2. Allocate 100. Rounded up to a 128 block, split off the pool
+     *    by halving, which leaves one free buddy of every order above.
+     * 3. Allocate 1000. Rounded up to 1024, takes the free 1024 buddy.
+     * 4. Deallocate 100. Merges with its 128, 256 and 512 buddies, up
+     *    to the 1024 buddy of the allocated 1024 block.
+     * 5. Deallocate 1000. Merges back up to the whole pool.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 0, 0, 1);
+    assert_null(mem_pool_open(1000000, BUDDY));
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    pool_segment_t exp1[14] =
+            {
+                    {128, 1},
+                    {128, 0},
+                    {256, 0},
+                    {512, 0},
+                    {1024, 0},
+                    {2048, 0},
+                    {4096, 0},
+                    {8192, 0},
+                    {16384, 0},
+                    {32768, 0},
+                    {65536, 0},
+                    {131072, 0},
+                    {262144, 0},
+                    {524288, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 128, 1, 13);
+
+
+    void * alloc1 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc1);
+    pool_segment_t exp2[14] =
+            {
+                    {128, 1},
+                    {128, 0},
+                    {256, 0},
+                    {512, 0},
+                    {1024, 1},
+                    {2048, 0},
+                    {4096, 0},
+                    {8192, 0},
+                    {16384, 0},
+                    {32768, 0},
+                    {65536, 0},
+                    {131072, 0},
+                    {262144, 0},
+                    {524288, 0},
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 1152, 2, 12);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    pool_segment_t exp3[11] =
+            {
+                    {1024, 0},
+                    {1024, 1},
+                    {2048, 0},
+                    {4096, 0},
+                    {8192, 0},
+                    {16384, 0},
+                    {32768, 0},
+                    {65536, 0},
+                    {131072, 0},
+                    {262144, 0},
+                    {524288, 0},
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 1024, 1, 10);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***          8. SLAB SCENARIOS          ***/
+/*******************************************/
+
+static const size_t SLAB_OBJECT_SIZE = 32;
+static const unsigned SLAB_COUNT = 10;
+
+static int pool_slab_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating slab of %u x %lu bytes\n",
+         SLAB_COUNT, (long) SLAB_OBJECT_SIZE);
+    pool = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_slab_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario23(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 23:
+     *
+     * 1. Slab starts out as a single gap. A slab cannot be opened with
+     *    mem_pool_open.
+     * 2. Allocate 10 x 20. Each takes a whole slot, so the slab is full
+     *    and refuses more, as well as anything larger than a slot.
+     * 3. Deallocate (2, 1, 3), 6, 8
+     * 4. Allocate 20. Takes the most recently freed slot.
+     * 5. Deallocation of a pointer that is not a slot fails.
+     * 6. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, SLAB, SLAB_OBJECT_SIZE * SLAB_COUNT, 0, 0, 1);
+    assert_null(mem_pool_open(POOL_SIZE, SLAB));
+
+
+    void * *allocs = (void * *) calloc(SLAB_COUNT, sizeof(void *));
+    assert_non_null(allocs);
+
+    for (unsigned i=0; i<SLAB_COUNT; ++i) {
+        allocs[i] = mem_new_alloc(pool, 20);
+        assert_non_null(allocs[i]);
+    }
+    check_metadata(pool, SLAB, SLAB_OBJECT_SIZE * SLAB_COUNT, SLAB_OBJECT_SIZE * SLAB_COUNT, SLAB_COUNT, 0);
+    assert_null(mem_new_alloc(pool, 20));
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK); allocs[2]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK); allocs[1]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK); allocs[3]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[6]), ALLOC_OK); allocs[6]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[8]), ALLOC_OK);
+    assert_null(mem_new_alloc(pool, SLAB_OBJECT_SIZE + 1));
+    pool_segment_t exp1[8] =
+            {
+                    {32, 1},
+                    {96, 0},
+                    {32, 1},
+                    {32, 1},
+                    {32, 0},
+                    {32, 1},
+                    {32, 0},
+                    {32, 1},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, SLAB, SLAB_OBJECT_SIZE * SLAB_COUNT, 160, 5, 3);
+
+
+    void * alloc0 = mem_new_alloc(pool, 20);
+    assert_ptr_equal(alloc0, allocs[8]);
+    allocs[8] = alloc0;
+    check_metadata(pool, SLAB, SLAB_OBJECT_SIZE * SLAB_COUNT, 192, 6, 2);
+    assert_int_equal(mem_del_alloc(pool, (char *) alloc0 + 1), ALLOC_FAIL);
+
+
+    // clean up
+    for (unsigned i=0; i<SLAB_COUNT; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    free(allocs);
+
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***          9. ARENA SCENARIOS         ***/
+/*******************************************/
+
+static int pool_arena_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = ARENA;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "ARENA");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_arena_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario24(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 24:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 x 100. Each allocation follows the previous one.
+     * 3. Deallocation of a single allocation fails, and so does closing.
+     * 4. Allocate the rest of the pool. The pool is full.
+     * 5. Reset. The pool is a single gap again.
+     * 6. Allocate 100. Starts at the beginning of the pool again.
+     * 7. Clean up with another reset.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, ARENA, POOL_SIZE, 0, 0, 1);
+
+
+    const unsigned NUM_ALLOCS = 10;
+    char *first = mem_new_alloc(pool, 100);
+    assert_ptr_equal(first, pool->mem);
+    for (int i=1; i<NUM_ALLOCS; ++i) {
+        char *alloc = mem_new_alloc(pool, 100);
+        assert_ptr_equal(alloc, first + 100 * i);
+    }
+    pool_segment_t exp1[2] =
+            {
+                    {1000, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, ARENA, POOL_SIZE, 1000, 10, 1);
+    assert_int_equal(mem_del_alloc(pool, first), ALLOC_FAIL);
+    assert_int_equal(mem_pool_close(pool), ALLOC_NOT_FREED);
+
+
+    assert_non_null(mem_new_alloc(pool, pool->total_size - 1000));
+    assert_null(mem_new_alloc(pool, 1));
+    check_metadata(pool, ARENA, POOL_SIZE, POOL_SIZE, 11, 0);
+
+
+    assert_int_equal(mem_pool_reset(pool), ALLOC_OK);
+    check_pool(pool, exp0);
+    check_metadata(pool, ARENA, POOL_SIZE, 0, 0, 1);
+
+
+    assert_ptr_equal(mem_new_alloc(pool, 100), first);
+
+
+    // clean up
+    assert_int_equal(mem_pool_reset(pool), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+static void test_pool_scenario25(void **state) {
+
+    /*
+     * Scenario 25:
+     *
+     * 1. Open a FIRST_FIT, a BEST_FIT, and a SLAB pool.
+     * 2. Allocate 10 x 100 from each and deallocate every other one.
+     * 3. Reset. Each pool is a single gap again, and can be closed.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    pool_pt pools[3] =
+            {
+                    mem_pool_open(POOL_SIZE, FIRST_FIT),
+                    mem_pool_open(POOL_SIZE, BEST_FIT),
+                    mem_slab_open(100, 20),
+            };
+
+    const unsigned NUM_ALLOCS = 10;
+    for (int p=0; p<3; ++p) {
+        assert_non_null(pools[p]);
+        void *allocs[NUM_ALLOCS];
+        for (int i=0; i<NUM_ALLOCS; ++i) {
+            allocs[i] = mem_new_alloc(pools[p], 100);
+            assert_non_null(allocs[i]);
+        }
+        for (int i=1; i<NUM_ALLOCS; i+=2) {
+            assert_int_equal(mem_del_alloc(pools[p], allocs[i]), ALLOC_OK);
+        }
+        check_metadata(pools[p], pools[p]->policy, pools[p]->total_size, 500, 5, 5);
+
+        assert_int_equal(mem_pool_reset(pools[p]), ALLOC_OK);
+        pool_segment_t exp0[1] =
+                {
+                        {pools[p]->total_size, 0},
+                };
+        check_pool(pools[p], exp0);
+        check_metadata(pools[p], pools[p]->policy, pools[p]->total_size, 0, 0, 1);
+
+        assert_int_equal(mem_pool_close(pools[p]), ALLOC_OK);
+    }
+
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***      10. BOUNDARY_TAG SCENARIOS     ***/
+/*******************************************/
+
+static int pool_tag_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = BOUNDARY_TAG;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "BOUNDARY_TAG");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_tag_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario26(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 26:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 3 x 100. Each block holds a header, the data, and a
+     *    footer, rounded up to whole tags. The data pointer follows the
+     *    header.
+     * 3. Deallocate 1. The gap sits between two allocations.
+     * 4. Deallocate 0. Merges with the gap after it, found from the
+     *    header of the next block.
+     * 5. Deallocate 0 again. Fails.
+     * 6. Allocate 100. The merged gap is in the lowest non-empty size
+     *    class that is sufficient, so it is split.
+     * 7. Deallocate a pointer into the data of 2, behind a fake header.
+     *    Fails, as the tags around it do not match.
+     * 8. Deallocate 2. Merges with the gaps on both sides of it.
+     * 9. Clean up.
+     */
+
+    const size_t TAG = sizeof(size_t);
+    const size_t BLOCK = (100 + 2 * TAG + TAG - 1) / TAG * TAG;
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, BOUNDARY_TAG, POOL_SIZE, 0, 0, 1);
+
+
+    char *allocs[3];
+    for (int i=0; i<3; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_ptr_equal(allocs[i], pool->mem + i * BLOCK + TAG);
+    }
+    check_metadata(pool, BOUNDARY_TAG, POOL_SIZE, 3 * BLOCK, 3, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    pool_segment_t exp1[4] =
+            {
+                    {BLOCK, 1},
+                    {BLOCK, 0},
+                    {BLOCK, 1},
+                    {pool->total_size - 3 * BLOCK, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BOUNDARY_TAG, POOL_SIZE, 2 * BLOCK, 2, 2);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    pool_segment_t exp2[3] =
+            {
+                    {2 * BLOCK, 0},
+                    {BLOCK, 1},
+                    {pool->total_size - 3 * BLOCK, 0},
+            };
+    check_pool(pool, exp2);
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_FAIL);
+
+
+    allocs[0] = mem_new_alloc(pool, 100);
+    assert_ptr_equal(allocs[0], pool->mem + TAG);
+    pool_segment_t exp3[4] =
+            {
+                    {BLOCK, 1},
+                    {BLOCK, 0},
+                    {BLOCK, 1},
+                    {pool->total_size - 3 * BLOCK, 0},
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, BOUNDARY_TAG, POOL_SIZE, 2 * BLOCK, 2, 2);
+
+
+    *(size_t *) (allocs[2] + 2 * TAG) = (4 * TAG) | 1;
+    assert_int_equal(mem_del_alloc(pool, allocs[2] + 3 * TAG), ALLOC_FAIL);
+    check_pool(pool, exp3);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK);
+    pool_segment_t exp4[2] =
+            {
+                    {BLOCK, 1},
+                    {pool->total_size - BLOCK, 0},
+            };
+    check_pool(pool, exp4);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***     11. DATA POINTER SCENARIOS      ***/
+/*******************************************/
+
+static void test_pool_scenario27(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 27:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 10000, 100. The data of each follows the previous.
+     * 3. The size of an allocation can be found from its handle, from
+     *    its data pointer, or from any pointer into its data, but not
+     *    from a pointer into a gap.
+     * 4. Deallocate 10000 by a pointer into its data. Fails.
+     * 5. Deallocate 10000 by its data pointer. The pointer no longer
+     *    points into an allocation.
+     * 6. Allocate 600 of 1 to 20 bytes into the gap of 10000, so pages
+     *    and granules hold many of them. Each is found from any pointer
+     *    into its data, and deallocated by its data pointer.
+     * 7. Clean up, by data pointer and by handle.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 10000);
+    assert_non_null(alloc1);
+    void * alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc2);
+    char *data0 = pool->mem;
+    char *data1 = pool->mem + 100;
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 10200, 3, 1);
+
+
+    assert_int_equal(mem_alloc_size(pool, alloc1), 10000);
+    assert_int_equal(mem_alloc_size(pool, data1), 10000);
+    assert_int_equal(mem_alloc_size(pool, data1 + 5000), 10000);
+    assert_int_equal(mem_alloc_size(pool, data1 + 9999), 10000);
+    assert_int_equal(mem_alloc_size(pool, data1 + 10000), 100);
+    assert_int_equal(mem_alloc_size(pool, data0 + 99), 100);
+    assert_int_equal(mem_alloc_size(pool, pool->mem + 20000), 0);
+
+
+    assert_int_equal(mem_del_alloc(pool, data1 + 5000), ALLOC_FAIL);
+    assert_int_equal(mem_del_alloc(pool, data1), ALLOC_OK);
+    assert_int_equal(mem_alloc_size(pool, data1 + 5000), 0);
+    pool_segment_t exp1[4] =
+            {
+                    {100, 1},
+                    {10000, 0},
+                    {100, 1},
+                    {pool->total_size - 10200, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 200, 2, 2);
+
+
+    // note: the best fit for each is the gap of 10000, at its start
+    void *smallAllocs[600];
+    char *smallData[600];
+    char *next = data1;
+    for (unsigned i = 0; i < 600; ++i) {
+        smallAllocs[i] = mem_new_alloc(pool, 1 + i % 20);
+        assert_non_null(smallAllocs[i]);
+        smallData[i] = next;
+        next += 1 + i % 20;
+    }
+    for (unsigned i = 0; i < 600; ++i) {
+        for (unsigned offset = 0; offset <= i % 20; ++offset) {
+            assert_int_equal(mem_alloc_size(pool, smallData[i] + offset), 1 + i % 20);
+        }
+    }
+    for (unsigned i = 0; i < 600; ++i) {
+        assert_int_equal(mem_del_alloc(pool, smallData[i]), ALLOC_OK);
+    }
+    check_pool(pool, exp1);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, data0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***    12. ALIGNED ALLOCATION SCENARIOS ***/
+/*******************************************/
+
+static void test_pool_scenario28(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 28:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10.
+     * 3. Allocate 100, aligned to a cache line. The padding up to the
+     *    cache line stays a gap.
+     * 4. Allocate 3. Fits into the padding, as the first fit.
+     * 5. An alignment that is not a power of two fails.
+     * 6. Allocate 10, aligned to a page. Skips the gap of 3 or more left
+     *    in the padding, since it holds no page boundary.
+     * 7. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+    // note: the pool is aligned at least to 8, so the padding after the
+    // first 10 bytes is at least 6
+    size_t padding0 = (size_t) (-(uintptr_t) (pool->mem + 10) & (MEM_ALIGN_CACHE_LINE - 1));
+    size_t offset1 = 10 + padding0 + 100;
+    size_t padding1 = (size_t) (-(uintptr_t) (pool->mem + offset1) & (MEM_ALIGN_PAGE - 1));
+
+
+    void * alloc0 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc_aligned(pool, 100, MEM_ALIGN_CACHE_LINE);
+    assert_non_null(alloc1);
+    assert_ptr_equal(((char * *) alloc1)[0], pool->mem + 10 + padding0);
+    pool_segment_t exp1[4] =
+            {
+                    {10, 1},
+                    {padding0, 0},
+                    {100, 1},
+                    {pool->total_size - offset1, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 110, 2, 2);
+
+
+    void * alloc2 = mem_new_alloc(pool, 3);
+    assert_non_null(alloc2);
+    assert_ptr_equal(((char * *) alloc2)[0], pool->mem + 10);
+    assert_null(mem_new_alloc_aligned(pool, 10, 3));
+
+
+    void * alloc3 = mem_new_alloc_aligned(pool, 10, MEM_ALIGN_PAGE);
+    assert_non_null(alloc3);
+    assert_ptr_equal(((char * *) alloc3)[0], pool->mem + offset1 + padding1);
+    assert_int_equal((uintptr_t) ((char * *) alloc3)[0] % MEM_ALIGN_PAGE, 0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 123, 4, (padding1 > 0) ? 3 : 2);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***     13. REALLOCATION SCENARIOS      ***/
+/*******************************************/
+
+static void test_pool_scenario29(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 29:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 100.
+     * 3. Grow the second to 150. Stays in place, taking from the gap.
+     * 4. Shrink the second to 50, by data pointer. Stays in place, giving
+     *    the tail back to the gap.
+     * 5. Shrink the first to 60. The tail becomes a new gap.
+     * 6. Grow the first to 200. The gap after it is too small, so it moves
+     *    to the first gap that fits, keeping its data.
+     * 7. Allocate 10 aligned to 64, in the first gap, and grow it to 300.
+     *    It moves to the last gap, still aligned to 64, keeping its data.
+     * 8. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc1);
+    memset(((char * *) alloc0)[0], 'a', 100);
+
+
+    assert_ptr_equal(mem_realloc(pool, alloc1, 150), alloc1);
+    pool_segment_t exp1[3] =
+            {
+                    {100, 1},
+                    {150, 1},
+                    {pool->total_size - 250, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 250, 2, 1);
+
+
+    char * mem1 = ((char * *) alloc1)[0];
+    assert_ptr_equal(mem_realloc(pool, mem1, 50), mem1);
+    pool_segment_t exp2[3] =
+            {
+                    {100, 1},
+                    {50, 1},
+                    {pool->total_size - 150, 0},
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 150, 2, 1);
+
+
+    assert_ptr_equal(mem_realloc(pool, alloc0, 60), alloc0);
+    pool_segment_t exp3[4] =
+            {
+                    {60, 1},
+                    {40, 0},
+                    {50, 1},
+                    {pool->total_size - 150, 0},
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 110, 2, 2);
+
+
+    alloc0 = mem_realloc(pool, alloc0, 200);
+    assert_non_null(alloc0);
+    assert_ptr_equal(((char * *) alloc0)[0], pool->mem + 150);
+    for (unsigned i = 0; i < 60; ++i) {
+        assert_int_equal(((char * *) alloc0)[0][i], 'a');
+    }
+    pool_segment_t exp4[4] =
+            {
+                    {100, 0},
+                    {50, 1},
+                    {200, 1},
+                    {pool->total_size - 350, 0},
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 250, 2, 2);
+
+
+    void * alloc2 = mem_new_alloc_aligned(pool, 10, MEM_ALIGN_CACHE_LINE);
+    assert_non_null(alloc2);
+    assert_true(((char * *) alloc2)[0] < pool->mem + 100);
+    memset(((char * *) alloc2)[0], 'b', 10);
+    alloc2 = mem_realloc(pool, alloc2, 300);
+    assert_non_null(alloc2);
+    char * mem2 = ((char * *) alloc2)[0];
+    size_t padding2 = (size_t) (-(uintptr_t) (pool->mem + 350) & (MEM_ALIGN_CACHE_LINE - 1));
+    assert_ptr_equal(mem2, pool->mem + 350 + padding2);
+    assert_int_equal((uintptr_t) mem2 % MEM_ALIGN_CACHE_LINE, 0);
+    for (unsigned i = 0; i < 10; ++i) {
+        assert_int_equal(mem2[i], 'b');
+    }
+    pool_segment_t exp5[6] =
+            {
+                    {100, 0},
+                    {50, 1},
+                    {200, 1},
+                    {padding2, 0},
+                    {300, 1},
+                    {pool->total_size - 650 - padding2, 0},
+            };
+    check_pool(pool, exp5);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 550, 3, 3);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***    14. GROWABLE POOL SCENARIOS      ***/
+/*******************************************/
+
+static const size_t GROW_POOL_SIZE = 1000;
+
+static void test_pool_scenario30(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 30:
+     *
+     * 1. Open a growable FIRST_FIT pool. A BUDDY pool cannot grow.
+     * 2. Allocate 600, 300.
+     * 3. Allocate 200. No gap fits, so the pool grows by an extent as
+     *    large as the pool so far.
+     * 4. Deallocate the 300 and, by data pointer, the 200. The gaps at
+     *    the end of the first extent and at the start of the second are
+     *    not merged.
+     * 5. Allocate 3000. The pool grows by an extent that holds it.
+     * 6. Reset. Each extent is a single gap again, and the pool can be
+     *    closed.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    assert_null(mem_pool_open_growable(BUDDY_POOL_SIZE, BUDDY));
+    pool_pt pool = mem_pool_open_growable(GROW_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+
+
+    void * alloc0 = mem_new_alloc(pool, 600);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc1);
+    check_metadata(pool, FIRST_FIT, GROW_POOL_SIZE, 900, 2, 1);
+
+
+    void * alloc2 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc2);
+    pool_segment_t exp1[5] =
+            {
+                    {600, 1},
+                    {300, 1},
+                    {100, 0},
+                    {200, 1},
+                    {800, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, 2 * GROW_POOL_SIZE, 1100, 3, 2);
+
+
+    char * mem2 = ((char * *) alloc2)[0];
+    assert_int_equal(mem_alloc_size(pool, mem2 + 100), 200);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, mem2), ALLOC_OK);
+    pool_segment_t exp2[3] =
+            {
+                    {600, 1},
+                    {400, 0},
+                    {1000, 0},
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, 2 * GROW_POOL_SIZE, 600, 1, 2);
+
+
+    void * alloc3 = mem_new_alloc(pool, 3000);
+    assert_non_null(alloc3);
+    check_metadata(pool, FIRST_FIT, 5 * GROW_POOL_SIZE, 3600, 2, 2);
+
+
+    assert_int_equal(mem_pool_reset(pool), ALLOC_OK);
+    pool_segment_t exp3[3] =
+            {
+                    {1000, 0},
+                    {1000, 0},
+                    {3000, 0},
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, FIRST_FIT, 5 * GROW_POOL_SIZE, 0, 0, 3);
+
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***    15. THREAD-SAFE POOL SCENARIOS   ***/
+/*******************************************/
+
+#ifdef MEM_POOL_THREAD_SAFE
+
+static const unsigned THREAD_COUNT = 4;
+static const unsigned THREAD_ALLOCS = 100;
+static const unsigned THREAD_ROUNDS = 100;
+
+// allocates and deallocates on the given pool, or on one of its own
+static void *thread_churn(void *arg) {
+    pool_pt shared = arg;
+    pool_pt pool = (shared != NULL) ? shared : mem_pool_open(POOL_SIZE, BEST_FIT);
+    if (pool == NULL) {
+        return "open";
+    }
+
+    void *allocs[THREAD_ALLOCS];
+    for (unsigned r = 0; r < THREAD_ROUNDS; ++r) {
+        for (unsigned i = 0; i < THREAD_ALLOCS; ++i) {
+            allocs[i] = mem_new_alloc(pool, 10 + i);
+            if (allocs[i] == NULL) {
+                return "alloc";
+            }
+        }
+        for (unsigned i = 0; i < THREAD_ALLOCS; ++i) {
+            if (mem_del_alloc(pool, allocs[i]) != ALLOC_OK) {
+                return "del";
+            }
+        }
+    }
+
+    if (shared == NULL && mem_pool_close(pool) != ALLOC_OK) {
+        return "close";
+    }
+    return NULL;
+}
+
+static void test_pool_scenario31(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 31:
+     *
+     * 1. Open and close a pool in each of several threads, and allocate
+     *    and deallocate on it in between.
+     * 2. Allocate and deallocate on a single pool from several threads.
+     *    The pool is a single gap again afterwards.
+     * 3. The same, on a pool with thread caches. Most allocations come out
+     *    of the caches, and closing the pool flushes them.
+     * 4. The same, on a pool of 2 shards.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt shared = mem_pool_open(POOL_SIZE, FIRST_FIT);
+    assert_non_null(shared);
+    pool_pt cached = mem_pool_open(POOL_SIZE, TLSF);
+    assert_non_null(cached);
+    assert_int_equal(mem_pool_set_thread_cache(cached, 16), ALLOC_OK);
+    pool_pt sharded = mem_pool_open_sharded(POOL_SIZE, FIRST_FIT, 2);
+    assert_non_null(sharded);
+
+    pool_pt pools[4] = { NULL, shared, cached, sharded };
+    for (int p=0; p<4; ++p) {
+        pthread_t threads[THREAD_COUNT];
+        for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+            assert_int_equal(pthread_create(&threads[t], NULL, thread_churn, pools[p]), 0);
+        }
+        for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+            void *error;
+            assert_int_equal(pthread_join(threads[t], &error), 0);
+            assert_null(error);
+        }
+    }
+
+    pool_segment_t exp0[1] =
+            {
+                    {POOL_SIZE, 0},
+            };
+    check_pool(shared, exp0);
+    check_metadata(shared, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+    size_t hits, misses;
+    assert_int_equal(mem_pool_thread_cache_stats(cached, &hits, &misses), ALLOC_OK);
+    assert_int_equal(hits + misses, THREAD_COUNT * THREAD_ROUNDS * THREAD_ALLOCS);
+    assert_true(hits > misses);
+
+    assert_int_equal(mem_pool_close(shared), ALLOC_OK);
+    assert_int_equal(mem_pool_close(cached), ALLOC_OK);
+    check_metadata(sharded, FIRST_FIT, POOL_SIZE, 0, 0, 2);
+    assert_int_equal(mem_pool_close(sharded), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+#endif
+
+/*******************************************/
+/***     16. THREAD CACHE SCENARIOS      ***/
+/*******************************************/
+
+static void test_pool_scenario32(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 32:
+     *
+     * 1. Pool starts out as a single gap. Give it thread caches of 4
+     *    blocks per size class.
+     * 2. Allocate 20. A miss: allocates a batch of 2 blocks of 32, the
+     *    full size of the class, and keeps one in the cache.
+     * 3. Allocate 30. A hit: the cached block.
+     * 4. Allocate 100. A miss: allocates a batch of 2 blocks of 112.
+     * 5. Deallocate the 20 and the 30. Both go into the cache, so they
+     *    are still allocations in the pool, which the stats report as
+     *    cached, with the block of 112 allocated ahead.
+     * 6. Deallocate the 20 again, a buffer on the stack, and a handle of
+     *    another pool. All fail, and the cache is left as it was.
+     * 7. Allocate 32. A hit: the block deallocated last.
+     * 8. Turn the thread caches off. The cached blocks go back to the pool,
+     *    and none are reported as cached.
+     * 9. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+    assert_int_equal(mem_pool_set_thread_cache(pool, 4), ALLOC_OK);
+
+
+    void * alloc0 = mem_new_alloc(pool, 20);
+    assert_non_null(alloc0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 64, 2, 1);
+
+
+    void * alloc1 = mem_new_alloc(pool, 30);
+    assert_non_null(alloc1);
+    assert_ptr_equal(((char * *) alloc1)[0], ((char * *) alloc0)[0] + 32);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 64, 2, 1);
+
+
+    void * alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 288, 4, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 288, 4, 1);
+    pool_stats_t stats;
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.cached_blocks, 3);
+    assert_int_equal(stats.cached_size, 176);
+
+
+    char stack[64] = {0};
+    pool_pt other = mem_pool_open(POOL_SIZE, FIRST_FIT);
+    assert_non_null(other);
+    void * foreign = mem_new_alloc(other, 32);
+    assert_non_null(foreign);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_FAIL);
+    assert_int_equal(mem_del_alloc(pool, stack), ALLOC_FAIL);
+    assert_int_equal(mem_del_alloc(pool, foreign), ALLOC_FAIL);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 288, 4, 1);
+    assert_int_equal(mem_del_alloc(other, foreign), ALLOC_OK);
+    assert_int_equal(mem_pool_close(other), ALLOC_OK);
+
+
+    void * alloc3 = mem_new_alloc(pool, 32);
+    assert_ptr_equal(alloc3, alloc1);
+    size_t hits, misses;
+    assert_int_equal(mem_pool_thread_cache_stats(pool, &hits, &misses), ALLOC_OK);
+    assert_int_equal(hits, 2);
+    assert_int_equal(misses, 2);
+
+
+    assert_int_equal(mem_pool_set_thread_cache(pool, 0), ALLOC_OK);
+    pool_segment_t exp1[4] =
+            {
+                    {32, 0},
+                    {32, 1},
+                    {112, 1},
+                    {pool->total_size - 176, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 144, 2, 2);
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.cached_blocks, 0);
+    assert_int_equal(stats.cached_size, 0);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***      17. REMOTE FREE SCENARIOS      ***/
+/*******************************************/
+
+#ifdef MEM_POOL_THREAD_SAFE
+
+static const unsigned REMOTE_ALLOCS = 1100;
+
+typedef struct _remote_work {
+    pool_pt pool;
+    void **allocs;
+    unsigned num_allocs;
+    int take_owner;
+} remote_work_t;
+
+// deallocates the given allocations, optionally as the owner of the pool
+static void *remote_del(void *arg) {
+    remote_work_t *work = arg;
+    if (work->take_owner && mem_pool_set_owner(work->pool) != ALLOC_OK) {
+        return "owner";
+    }
+    for (unsigned i = 0; i < work->num_allocs; ++i) {
+        if (mem_del_alloc(work->pool, work->allocs[i]) != ALLOC_OK) {
+            return "del";
+        }
+    }
+    return NULL;
+}
+
+static void run_remote_del(remote_work_t *work) {
+    pthread_t thread;
+    void *error;
+    assert_int_equal(pthread_create(&thread, NULL, remote_del, work), 0);
+    assert_int_equal(pthread_join(thread, &error), 0);
+    assert_null(error);
+}
+
+static void test_pool_scenario33(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 33:
+     *
+     * 1. Open a pool, which makes this thread its owner. Allocate 1100
+     *    blocks of 1.
+     * 2. Deallocate them all in another thread. The first 1024 fill the
+     *    remote-free queue, the next one drains it under the lock, and
+     *    the last 75 are queued again, so they are still allocations.
+     * 3. Inspect the pool. The queue is drained, so it is a single gap.
+     * 4. Allocate 1100 again, and deallocate them in another thread that
+     *    takes over the pool first. All are deallocated right away.
+     * 5. Make this thread the owner again. In another thread, deallocate
+     *    a buffer on the stack, which fails right away, and then the same
+     *    handle twice. Both are queued, and the second one fails as the
+     *    queue is drained, which the stats count.
+     * 6. Clean up.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pool = mem_pool_open(POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+    void *allocs[REMOTE_ALLOCS];
+    for (unsigned i = 0; i < REMOTE_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 1);
+        assert_non_null(allocs[i]);
+    }
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, REMOTE_ALLOCS, REMOTE_ALLOCS, 1);
+
+
+    remote_work_t work = { pool, allocs, REMOTE_ALLOCS, 0 };
+    run_remote_del(&work);
+    assert_int_equal(pool->num_allocs, 75);
+    assert_int_equal(pool->num_gaps, 2);
+
+
+    pool_segment_t exp0[1] =
+            {
+                    {POOL_SIZE, 0},
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    for (unsigned i = 0; i < REMOTE_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 1);
+        assert_non_null(allocs[i]);
+    }
+    work.take_owner = 1;
+    run_remote_del(&work);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    assert_int_equal(mem_pool_set_owner(pool), ALLOC_OK);
+    char stack[64] = {0};
+    void *bad[1] = { stack };
+    remote_work_t badWork = { pool, bad, 1, 0 };
+    pthread_t thread;
+    void *error;
+    assert_int_equal(pthread_create(&thread, NULL, remote_del, &badWork), 0);
+    assert_int_equal(pthread_join(thread, &error), 0);
+    assert_non_null(error);
+
+    void *twice[2];
+    twice[0] = twice[1] = mem_new_alloc(pool, 1);
+    assert_non_null(twice[0]);
+    remote_work_t twiceWork = { pool, twice, 2, 0 };
+    run_remote_del(&twiceWork);
+    assert_int_equal(pool->num_allocs, 1);
+    pool_stats_t stats;
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.remote_failures, 1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    // clean up
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+#endif
+
+/*******************************************/
+/***      18. SHARDED POOL SCENARIOS     ***/
+/*******************************************/
+
+static const size_t SHARD_POOL_SIZE = 1000;
+
+static void test_pool_scenario34(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 34:
+     *
+     * 1. Open a FIRST_FIT pool of 2 shards of 500. A BUDDY pool cannot
+     *    be sharded.
+     * 2. Allocate 400. It comes out of the shard of this thread.
+     * 3. Allocate 300. The shard has only 100 left, so it borrows a gap
+     *    of 300 from the other shard, which is left with 200.
+     * 4. Deallocate the 300, by data pointer. The loan is a single gap
+     *    again, so it is given back, and the other shard is one gap of
+     *    500. Borrow the 300 again, into the freed slot, and deallocate
+     *    it by handle, which gives it back as well.
+     * 5. Reset. Each shard is a single gap.
+     * 6. Allocate 400 and 300 again. The pool cannot be closed with the
+     *    allocations, and can once they are deallocated.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    assert_null(mem_pool_open_sharded(BUDDY_POOL_SIZE, BUDDY, 2));
+    pool_pt pool = mem_pool_open_sharded(SHARD_POOL_SIZE, FIRST_FIT, 2);
+    assert_non_null(pool);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 0, 0, 2);
+
+
+    void * alloc0 = mem_new_alloc(pool, 400);
+    assert_non_null(alloc0);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 400, 1, 2);
+
+
+    void * alloc1 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc1);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 700, 2, 2);
+
+
+    char * mem1 = ((char * *) alloc1)[0];
+    assert_int_equal(mem_alloc_size(pool, mem1 + 100), 300);
+    assert_int_equal(mem_del_alloc(pool, mem1), ALLOC_OK);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 400, 1, 2);
+
+    alloc1 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc1);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 700, 2, 2);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 400, 1, 2);
+
+
+    assert_int_equal(mem_pool_reset(pool), ALLOC_OK);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 0, 0, 2);
+
+
+    alloc0 = mem_new_alloc(pool, 400);
+    assert_non_null(alloc0);
+    alloc1 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc1);
+    check_metadata(pool, FIRST_FIT, SHARD_POOL_SIZE, 700, 2, 2);
+    assert_int_equal(mem_pool_close(pool), ALLOC_NOT_FREED);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***        19. POOL STORE SCENARIOS     ***/
+/*******************************************/
+
+#define STORE_POOLS 100
+static const unsigned STORE_ROUNDS = 1000;
+static const size_t STORE_POOL_SIZE = 100;
+
+// opens and closes pools, keeping a few open at a time
+static void *store_churn(void *arg) {
+    (void) arg; /* unused */
+    pool_pt pools[4];
+    for (unsigned r = 0; r < STORE_ROUNDS; ++r) {
+        for (unsigned p = 0; p < 4; ++p) {
+            pools[p] = mem_pool_open(STORE_POOL_SIZE, (alloc_policy) p);
+            if (pools[p] == NULL) {
+                return "open";
+            }
+        }
+        for (unsigned p = 0; p < 4; ++p) {
+            if (mem_pool_close(pools[p]) != ALLOC_OK) {
+                return "close";
+            }
+        }
+    }
+    return NULL;
+}
+
+static void test_pool_scenario35(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 35:
+     *
+     * 1. Open 100 pools, and close every other one. The store cannot be
+     *    freed while any pool is open.
+     * 2. Open 50 pools again, in the slots of the closed ones, and check
+     *    that every pool still works.
+     * 3. Open and close pools over and over, from several threads in
+     *    thread-safe builds. The store is freed once all are closed.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pools[STORE_POOLS];
+    for (unsigned p = 0; p < STORE_POOLS; ++p) {
+        pools[p] = mem_pool_open(STORE_POOL_SIZE, FIRST_FIT);
+        assert_non_null(pools[p]);
+    }
+    for (unsigned p = 0; p < STORE_POOLS; p += 2) {
+        assert_int_equal(mem_pool_close(pools[p]), ALLOC_OK);
+    }
+    assert_int_equal(mem_free(), ALLOC_NOT_FREED);
+
+
+    for (unsigned p = 0; p < STORE_POOLS; p += 2) {
+        pools[p] = mem_pool_open(STORE_POOL_SIZE, BEST_FIT);
+        assert_non_null(pools[p]);
+    }
+    for (unsigned p = 0; p < STORE_POOLS; ++p) {
+        void * alloc0 = mem_new_alloc(pools[p], STORE_POOL_SIZE);
+        assert_non_null(alloc0);
+        check_metadata(pools[p], (p % 2) ? FIRST_FIT : BEST_FIT, STORE_POOL_SIZE, STORE_POOL_SIZE, 1, 0);
+        assert_int_equal(mem_del_alloc(pools[p], alloc0), ALLOC_OK);
+    }
+
+
+#ifdef MEM_POOL_THREAD_SAFE
+    pthread_t threads[THREAD_COUNT];
+    for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+        assert_int_equal(pthread_create(&threads[t], NULL, store_churn, NULL), 0);
+    }
+    for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+        void *error;
+        assert_int_equal(pthread_join(threads[t], &error), 0);
+        assert_null(error);
+    }
+#else
+    assert_null(store_churn(NULL));
+#endif
+
+
+    // clean up
+    for (unsigned p = 0; p < STORE_POOLS; ++p) {
+        assert_int_equal(mem_pool_close(pools[p]), ALLOC_OK);
+    }
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***        20. SNAPSHOT SCENARIOS       ***/
+/*******************************************/
+
+static const unsigned SNAPSHOT_ALLOCS = 8;
+static const size_t SNAPSHOT_ALLOC_SIZE = 64;
+
+// checks that a snapshot of a pool that no thread is using lists the same
+// segments as the inspection does
+static void check_snapshot(pool_pt pool) {
+    pool_segment_pt segs = NULL, snap = NULL;
+    unsigned size = 0, snap_size = 0;
+
+    mem_inspect_pool(pool, &segs, &size);
+    assert_int_equal(mem_inspect_pool_snapshot(pool, &snap, &snap_size), ALLOC_OK);
+    assert_non_null(snap);
+    assert_int_equal(snap_size, size);
+    for (unsigned u = 0; u < size; u ++) {
+        assert_int_equal(snap[u].size, segs[u].size);
+        assert_int_equal(snap[u].allocated, segs[u].allocated);
+    }
+
+    free(segs);
+    free(snap);
+}
+
+#ifdef MEM_POOL_THREAD_SAFE
+// takes snapshots of the pool until told to stop, and checks that each
+// covers the whole pool without two gaps in a row
+static void *snapshot_monitor(void *arg) {
+    pool_pt pool = arg;
+    unsigned taken = 0;
+    while (taken < THREAD_ROUNDS) {
+        pool_segment_pt snap = NULL;
+        unsigned snap_size = 0;
+        if (mem_inspect_pool_snapshot(pool, &snap, &snap_size) != ALLOC_OK) {
+            continue;
+        }
+        size_t total = 0;
+        for (unsigned u = 0; u < snap_size; u ++) {
+            total += snap[u].size;
+            if (u > 0 && ! snap[u].allocated && ! snap[u - 1].allocated) {
+                free(snap);
+                return "adjacent gaps";
+            }
+        }
+        free(snap);
+        if (total != POOL_SIZE) {
+            return "total";
+        }
+        taken++;
+    }
+    return NULL;
+}
+
+static const unsigned SNAPSHOT_READ_ALLOCS = 10000;
+
+// only reads the pool, with the calls that take its lock: its stats, the
+// size of its first allocation, and its segments; holds the lock most of
+// the time, as the pool has many segments
+static void *pool_reader(void *arg) {
+    pool_pt pool = arg;
+    for (unsigned r = 0; r < THREAD_ROUNDS; ++r) {
+        pool_stats_t stats;
+        if (mem_pool_stats(pool, &stats) != ALLOC_OK ||
+            mem_alloc_size(pool, pool->mem) != SNAPSHOT_ALLOC_SIZE) {
+            return "read";
+        }
+        pool_segment_pt segs = NULL;
+        unsigned size = 0;
+        mem_inspect_pool(pool, &segs, &size);
+        free(segs);
+    }
+    return NULL;
+}
+#endif
+
+static void test_pool_scenario36(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 36:
+     *
+     * 1. Fragment a pool of each policy, and a sharded pool, by
+     *    deallocating every other allocation. A snapshot lists the same
+     *    segments as mem_inspect_pool.
+     * 2. In thread-safe builds, take snapshots of a pool while several
+     *    threads allocate and deallocate on it. Each one covers the whole
+     *    pool, without two gaps in a row.
+     * 3. In thread-safe builds, take snapshots of a fragmented pool while
+     *    several threads only read it. The calls that only read the pool
+     *    do not make a snapshot start over, so none fails, and each lists
+     *    the same segments as mem_inspect_pool.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pools[9];
+    for (int p=0; p<8; ++p) {
+        if ((alloc_policy) p == SLAB) {
+            pools[p] = mem_slab_open(SNAPSHOT_ALLOC_SIZE, 2 * SNAPSHOT_ALLOCS);
+        } else {
+            pools[p] = mem_pool_open((p == BUDDY) ? BUDDY_POOL_SIZE : POOL_SIZE, (alloc_policy) p);
+        }
+        assert_non_null(pools[p]);
+    }
+    pools[8] = mem_pool_open_sharded(POOL_SIZE, TLSF, 2);
+    assert_non_null(pools[8]);
+
+    for (int p=0; p<9; ++p) {
+        check_snapshot(pools[p]);
+        void *allocs[SNAPSHOT_ALLOCS];
+        for (unsigned i = 0; i < SNAPSHOT_ALLOCS; ++i) {
+            allocs[i] = mem_new_alloc(pools[p], SNAPSHOT_ALLOC_SIZE);
+            assert_non_null(allocs[i]);
+        }
+        for (unsigned i = 0; i < SNAPSHOT_ALLOCS; i += 2) {
+            if (p != ARENA) {
+                assert_int_equal(mem_del_alloc(pools[p], allocs[i]), ALLOC_OK);
+            }
+        }
+        check_snapshot(pools[p]);
+        assert_int_equal(mem_pool_reset(pools[p]), ALLOC_OK);
+        assert_int_equal(mem_pool_close(pools[p]), ALLOC_OK);
+    }
+
+
+#ifdef MEM_POOL_THREAD_SAFE
+    pool_pt shared = mem_pool_open(POOL_SIZE, FIRST_FIT);
+    assert_non_null(shared);
+    pthread_t monitor;
+    pthread_t threads[THREAD_COUNT];
+    assert_int_equal(pthread_create(&monitor, NULL, snapshot_monitor, shared), 0);
+    for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+        assert_int_equal(pthread_create(&threads[t], NULL, thread_churn, shared), 0);
+    }
+    for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+        void *error;
+        assert_int_equal(pthread_join(threads[t], &error), 0);
+        assert_null(error);
+    }
+    void *error;
+    assert_int_equal(pthread_join(monitor, &error), 0);
+    assert_null(error);
+    check_snapshot(shared);
+    assert_int_equal(mem_pool_close(shared), ALLOC_OK);
+
+
+    pool_pt read = mem_pool_open(POOL_SIZE, FIRST_FIT);
+    assert_non_null(read);
+    void *readAllocs[SNAPSHOT_READ_ALLOCS];
+    for (unsigned i = 0; i < SNAPSHOT_READ_ALLOCS; ++i) {
+        readAllocs[i] = mem_new_alloc(read, SNAPSHOT_ALLOC_SIZE);
+        assert_non_null(readAllocs[i]);
+    }
+    for (unsigned i = 1; i < SNAPSHOT_READ_ALLOCS; i += 2) {
+        assert_int_equal(mem_del_alloc(read, readAllocs[i]), ALLOC_OK);
+    }
+    pool_segment_pt segs = NULL;
+    unsigned size = 0;
+    mem_inspect_pool(read, &segs, &size);
+    for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+        assert_int_equal(pthread_create(&threads[t], NULL, pool_reader, read), 0);
+    }
+    for (unsigned r = 0; r < THREAD_ROUNDS; ++r) {
+        pool_segment_pt snap = NULL;
+        unsigned snap_size = 0;
+        assert_int_equal(mem_inspect_pool_snapshot(read, &snap, &snap_size), ALLOC_OK);
+        assert_int_equal(snap_size, size);
+        for (unsigned u = 0; u < size; u ++) {
+            assert_int_equal(snap[u].size, segs[u].size);
+            assert_int_equal(snap[u].allocated, segs[u].allocated);
+        }
+        free(snap);
+    }
+    for (unsigned t = 0; t < THREAD_COUNT; ++t) {
+        assert_int_equal(pthread_join(threads[t], &error), 0);
+        assert_null(error);
+    }
+    free(segs);
+    assert_int_equal(mem_pool_reset(read), ALLOC_OK);
+    assert_int_equal(mem_pool_close(read), ALLOC_OK);
+#endif
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***     21. DEFERRED FREE SCENARIOS     ***/
+/*******************************************/
+
+static const size_t DEFER_POOL_SIZE = 1000;
+
+static void test_pool_scenario37(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 37:
+     *
+     * 1. Open a FIRST_FIT pool with deferred frees. A SLAB pool cannot
+     *    defer its frees.
+     * 2. Allocate 5 x 100, and deallocate the 2nd, 3rd, and 4th. They stay
+     *    allocations until the pool is maintained, also as inspected,
+     *    and maintaining it merges them into a single gap of 300.
+     * 3. Allocate the rest of the pool, and deallocate the 2 x 100 left.
+     *    An allocation of 100 finds no gap, so it coalesces the deferred
+     *    frees and takes the first of the two gaps they leave.
+     * 4. Deallocate the 100 and turn deferred frees off, which coalesces
+     *    it. A BUDDY pool and a sharded pool defer their frees the same.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt slab = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(slab);
+    assert_int_equal(mem_pool_set_deferred_free(slab, 1), ALLOC_FAIL);
+    assert_int_equal(mem_pool_close(slab), ALLOC_OK);
+
+    pool_pt pool = mem_pool_open(DEFER_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+    assert_int_equal(mem_pool_set_deferred_free(pool, 1), ALLOC_OK);
+
+
+    void *allocs[5];
+    for (int i=0; i<5; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    for (int i=1; i<4; ++i) {
+        assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    pool_segment_t expDeferred[6] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {500, 0}
+            };
+    check_pool(pool, expDeferred);
+    check_metadata(pool, FIRST_FIT, DEFER_POOL_SIZE, 500, 5, 1);
+
+    assert_int_equal(mem_pool_maintain(pool), ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 2);
+    assert_int_equal(pool->num_gaps, 2);
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {500, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, DEFER_POOL_SIZE, 200, 2, 2);
+
+
+    void * alloc0 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 500);
+    assert_non_null(alloc1);
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+    assert_int_equal(pool->num_gaps, 0);
+    void * alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc2);
+    pool_segment_t exp1[4] =
+            {
+                    {100, 1},
+                    {300, 1},
+                    {100, 0},
+                    {500, 1}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, DEFER_POOL_SIZE, 900, 3, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_pool_set_deferred_free(pool, 0), ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 2);
+    assert_int_equal(pool->num_gaps, 2);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    check_metadata(pool, FIRST_FIT, DEFER_POOL_SIZE, 0, 0, 1);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+
+
+    pool_pt pools[2] = { mem_pool_open(BUDDY_POOL_SIZE, BUDDY),
+                         mem_pool_open_sharded(DEFER_POOL_SIZE, TLSF, 2) };
+    for (int p=0; p<2; ++p) {
+        assert_non_null(pools[p]);
+        assert_int_equal(mem_pool_set_deferred_free(pools[p], 1), ALLOC_OK);
+        for (int i=0; i<5; ++i) {
+            allocs[i] = mem_new_alloc(pools[p], 100);
+            assert_non_null(allocs[i]);
+        }
+        for (int i=0; i<5; ++i) {
+            assert_int_equal(mem_del_alloc(pools[p], allocs[i]), ALLOC_OK);
+        }
+        assert_int_equal(mem_pool_maintain(pools[p]), ALLOC_OK);
+        print_pool(pools[p]);
+        assert_int_equal(pools[p]->num_allocs, 0);
+        assert_int_equal(mem_pool_close(pools[p]), ALLOC_OK);
+    }
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***      22. BATCH ALLOCATION SCENARIOS ***/
+/*******************************************/
+
+static const size_t BATCH_POOL_SIZE = 1000;
+
+static void test_pool_scenario38(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 38:
+     *
+     * 1. Allocate 100, 200, and 300 in a batch. They are carved out of
+     *    the pool in order, leaving a gap of 400.
+     * 2. Allocate 300 and 300 in a batch. Only the first fits, so the
+     *    batch reports 1 allocation, and the second is null.
+     * 3. Deallocate the 200, and allocate 4 x 50 in a batch. They fill
+     *    its gap exactly.
+     * 4. A SLAB pool of 10 slots allocates 10 out of a batch of 12, and a
+     *    sharded pool allocates a batch as well.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pool = mem_pool_open(BATCH_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+
+    size_t sizes0[3] = { 100, 200, 300 };
+    void *allocs0[3];
+    assert_int_equal(mem_new_alloc_batch(pool, sizes0, 3, allocs0), 3);
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {200, 1},
+                    {300, 1},
+                    {400, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, BATCH_POOL_SIZE, 600, 3, 1);
+
+
+    size_t sizes1[2] = { 300, 300 };
+    void *allocs1[2];
+    assert_int_equal(mem_new_alloc_batch(pool, sizes1, 2, allocs1), 1);
+    assert_non_null(allocs1[0]);
+    assert_null(allocs1[1]);
+    check_metadata(pool, FIRST_FIT, BATCH_POOL_SIZE, 900, 4, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs0[1]), ALLOC_OK);
+    size_t sizes2[4] = { 50, 50, 50, 50 };
+    void *allocs2[4];
+    assert_int_equal(mem_new_alloc_batch(pool, sizes2, 4, allocs2), 4);
+    pool_segment_t exp1[8] =
+            {
+                    {100, 1},
+                    {50, 1},
+                    {50, 1},
+                    {50, 1},
+                    {50, 1},
+                    {300, 1},
+                    {300, 1},
+                    {100, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, BATCH_POOL_SIZE, 900, 7, 1);
+    assert_int_equal(mem_pool_reset(pool), ALLOC_OK);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+
+
+    pool_pt slab = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(slab);
+    size_t sizes3[12];
+    void *allocs3[12];
+    for (int i=0; i<12; ++i) {
+        sizes3[i] = SLAB_OBJECT_SIZE;
+    }
+    assert_int_equal(mem_new_alloc_batch(slab, sizes3, 12, allocs3), SLAB_COUNT);
+    assert_null(allocs3[SLAB_COUNT]);
+    check_metadata(slab, SLAB, SLAB_OBJECT_SIZE * SLAB_COUNT, SLAB_OBJECT_SIZE * SLAB_COUNT, SLAB_COUNT, 0);
+    assert_int_equal(mem_pool_reset(slab), ALLOC_OK);
+    assert_int_equal(mem_pool_close(slab), ALLOC_OK);
+
+    pool_pt sharded = mem_pool_open_sharded(BATCH_POOL_SIZE, TLSF, 2);
+    assert_non_null(sharded);
+    assert_int_equal(mem_new_alloc_batch(sharded, sizes0, 3, allocs0), 3);
+    check_metadata(sharded, TLSF, BATCH_POOL_SIZE, 600, 3, 2);
+    assert_int_equal(mem_pool_reset(sharded), ALLOC_OK);
+    assert_int_equal(mem_pool_close(sharded), ALLOC_OK);
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***      23. BATCH FREE SCENARIOS       ***/
+/*******************************************/
+
+static const size_t BATCH_FREE_POOL_SIZE = 1000;
+
+static void test_pool_scenario39(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 39:
+     *
+     * 1. Allocate 10 x 100 in a batch, filling the pool.
+     * 2. Deallocate the 9th, 3rd, 4th, 6th, 7th, and 10th in a batch, out
+     *    of order. Each run of them becomes a single gap.
+     * 3. Deallocate the 1st and the 3rd again in a batch. The batch fails
+     *    on the 3rd, but the 1st is deallocated.
+     * 4. Deallocate the rest in a batch, leaving a single gap.
+     * 5. A SLAB pool deallocates a batch of its slots one at a time.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pool = mem_pool_open(BATCH_FREE_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+
+    size_t sizes[10];
+    void *allocs[10];
+    for (int i=0; i<10; ++i) {
+        sizes[i] = 100;
+    }
+    assert_int_equal(mem_new_alloc_batch(pool, sizes, 10, allocs), 10);
+    check_metadata(pool, FIRST_FIT, BATCH_FREE_POOL_SIZE, 1000, 10, 0);
+
+
+    void *frees0[6] = { allocs[8], allocs[2], allocs[3], allocs[5], allocs[6], allocs[9] };
+    assert_int_equal(mem_del_alloc_batch(pool, frees0, 6), ALLOC_OK);
+    pool_segment_t exp0[7] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {200, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, BATCH_FREE_POOL_SIZE, 400, 4, 3);
+
+
+    void *frees1[2] = { allocs[0], allocs[2] };
+    assert_int_equal(mem_del_alloc_batch(pool, frees1, 2), ALLOC_FAIL);
+    pool_segment_t exp1[7] =
+            {
+                    {100, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {200, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, BATCH_FREE_POOL_SIZE, 300, 3, 4);
+
+
+    void *frees2[3] = { allocs[7], allocs[4], allocs[1] };
+    assert_int_equal(mem_del_alloc_batch(pool, frees2, 3), ALLOC_OK);
+    pool_segment_t exp2[1] =
+            {
+                    {BATCH_FREE_POOL_SIZE, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, BATCH_FREE_POOL_SIZE, 0, 0, 1);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+
+
+    pool_pt slab = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(slab);
+    for (unsigned i=0; i<SLAB_COUNT; ++i) {
+        allocs[i] = mem_new_alloc(slab, SLAB_OBJECT_SIZE);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc_batch(slab, allocs, SLAB_COUNT), ALLOC_OK);
+    check_metadata(slab, SLAB, SLAB_OBJECT_SIZE * SLAB_COUNT, 0, 0, 1);
+    assert_int_equal(mem_pool_close(slab), ALLOC_OK);
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***      24. QUICK LIST SCENARIOS       ***/
+/*******************************************/
+
+static const size_t QUICK_POOL_SIZE = 1000;
+
+static void test_pool_scenario40(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 40:
+     *
+     * 1. Allocate 4 x 100 and 500, and give the pool quick lists of 2.
+     * 2. Deallocate the 1st and the 2nd. They go on the quick list for
+     *    100, and stay allocated.
+     * 3. Allocate 100. The 2nd comes back off the list, before the gap of
+     *    100, and is deallocated again.
+     * 4. Deallocate the 3rd. The list is full, so the 1st and 2nd are
+     *    coalesced, and the 3rd goes on the list.
+     * 5. Allocate 300. No gap fits, so the list is coalesced, and the
+     *    gap of 300 is allocated.
+     * 6. Deallocate the 4th twice, which fails the second time, and turn
+     *    the quick lists off, which coalesces it.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pool = mem_pool_open(QUICK_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+
+    void *allocs[4];
+    for (int i=0; i<4; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    void * alloc0 = mem_new_alloc(pool, 500);
+    assert_non_null(alloc0);
+    assert_int_equal(mem_pool_set_quick_lists(pool, 2), ALLOC_OK);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    pool_segment_t exp0[6] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {500, 1},
+                    {100, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, QUICK_POOL_SIZE, 900, 5, 1);
+
+
+    void * alloc1 = mem_new_alloc(pool, 100);
+    assert_ptr_equal(alloc1, allocs[1]);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK);
+    pool_segment_t exp1[5] =
+            {
+                    {200, 0},
+                    {100, 1},
+                    {100, 1},
+                    {500, 1},
+                    {100, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, QUICK_POOL_SIZE, 700, 3, 2);
+
+
+    void * alloc2 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc2);
+    pool_segment_t exp2[4] =
+            {
+                    {300, 1},
+                    {100, 1},
+                    {500, 1},
+                    {100, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, QUICK_POOL_SIZE, 900, 3, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_FAIL);
+    assert_int_equal(mem_pool_set_quick_lists(pool, 0), ALLOC_OK);
+    pool_segment_t exp3[4] =
+            {
+                    {300, 1},
+                    {100, 0},
+                    {500, 1},
+                    {100, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, FIRST_FIT, QUICK_POOL_SIZE, 800, 2, 2);
+
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+
+
+    // only the pools with a gap index have quick lists
+    pool_pt slab = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(slab);
+    assert_int_equal(mem_pool_set_quick_lists(slab, 2), ALLOC_FAIL);
+    assert_int_equal(mem_pool_close(slab), ALLOC_OK);
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***      25. COMPACTION SCENARIOS       ***/
+/*******************************************/
+
+static const size_t COMPACT_POOL_SIZE = 1000;
+
+static void test_pool_scenario41(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 41:
+     *
+     * 1. Allocate 5 x 100, filling each with its number, and deallocate
+     *    the 1st and the 3rd.
+     * 2. Compact with a budget of 1 byte. The 2nd slides down into the
+     *    first gap, and the step stops before the next one.
+     * 3. Pin the 5th, and compact again. The 4th slides down, but the
+     *    5th stays, with the gap before it.
+     * 4. Unpin the 5th, and compact. It slides down too, and its handle
+     *    and data pointer both find it there.
+     * 5. Compact automatically with a threshold of 0.25. Deallocate the
+     *    2nd, allocate 300, and deallocate the 5th, which leaves a third
+     *    of the free memory outside the largest gap, so the pool is
+     *    compacted as it is freed.
+     * 6. A SLAB pool cannot be compacted.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pool = mem_pool_open(COMPACT_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+
+    void *allocs[5];
+    for (int i=0; i<5; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+        memset(pool->mem + 100 * i, i + 1, 100);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK);
+
+
+    assert_int_equal(mem_pool_compact(pool, 1), ALLOC_PARTIAL);
+    pool_segment_t exp0[5] =
+            {
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {100, 1},
+                    {500, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, COMPACT_POOL_SIZE, 300, 3, 2);
+    assert_int_equal(pool->mem[0], 2);
+    assert_int_equal(pool->mem[99], 2);
+
+
+    assert_int_equal(mem_pin_alloc(pool, allocs[4]), ALLOC_OK);
+    assert_int_equal(mem_pool_compact(pool, 0), ALLOC_OK);
+    pool_segment_t exp1[5] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {500, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, COMPACT_POOL_SIZE, 300, 3, 2);
+    assert_int_equal(pool->mem[100], 4);
+    assert_int_equal(pool->mem[400], 5);
+
+
+    assert_int_equal(mem_unpin_alloc(pool, allocs[4]), ALLOC_OK);
+    assert_int_equal(mem_pool_compact(pool, 0), ALLOC_OK);
+    pool_segment_t exp2[4] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {700, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, COMPACT_POOL_SIZE, 300, 3, 1);
+    assert_int_equal(pool->mem[200], 5);
+    assert_int_equal(pool->mem[299], 5);
+    assert_int_equal(mem_alloc_size(pool, allocs[4]), 100);
+    assert_int_equal(mem_alloc_size(pool, pool->mem + 200), 100);
+
+
+    assert_int_equal(mem_pool_set_auto_compact(pool, 1, 0), ALLOC_FAIL);
+    assert_int_equal(mem_pool_set_auto_compact(pool, 0.25, 0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    void *alloc0 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc0);
+    pool_segment_t exp3[5] =
+            {
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {300, 1},
+                    {400, 0}
+            };
+    check_pool(pool, exp3);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+    pool_segment_t exp4[3] =
+            {
+                    {100, 1},
+                    {300, 1},
+                    {600, 0}
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, FIRST_FIT, COMPACT_POOL_SIZE, 400, 2, 1);
+
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+
+
+    pool_pt slab = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(slab);
+    assert_int_equal(mem_pool_compact(slab, 0), ALLOC_FAIL);
+    assert_int_equal(mem_pool_close(slab), ALLOC_OK);
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***        26. STATISTICS SCENARIOS     ***/
+/*******************************************/
+
+static const size_t STATS_POOL_SIZE = 1000;
+
+static void test_pool_scenario42(void **state) {
+    (void) state; /* unused */
+
+    /*
+     * Scenario 42:
+     *
+     * 1. Open a pool. Its one gap of 1000 is in class 9, [512, 1024).
+     * 2. Allocate 5 x 100, and deallocate the 1st and the 3rd. The gaps
+     *    of 100 are in class 6, and the gap of 500 in class 8, and 200
+     *    of the 700 free bytes are outside the largest gap.
+     * 3. Allocate 800, which fails.
+     * 4. Deallocate the rest. The pool is one gap again, and the peaks
+     *    and the counts stay.
+     * 5. A SLAB pool counts each free slot as a gap, and is never
+     *    fragmented.
+     * 6. Allocate 100 and deallocate it 100 times over, through quick
+     *    lists, and then through thread caches, with one more allocation
+     *    live. Every call is counted, and the blocks held on the lists
+     *    and in the caches are the difference to num_allocs.
+     * 7. In a SEGREGATED_FIT and a TLSF pool, leave three gaps of 128,
+     *    and take them one by one. The largest gap stays 128 until the
+     *    last is taken.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_pt pool = mem_pool_open(STATS_POOL_SIZE, FIRST_FIT);
+    assert_non_null(pool);
+
+    pool_stats_t stats;
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.largest_gap, 1000);
+    assert_int_equal((int) (stats.fragmentation * 1000), 0);
+    assert_int_equal(stats.gap_histogram[9], 1);
+    assert_int_equal(stats.peak_alloc_size, 0);
+    assert_int_equal(stats.peak_used_nodes, 1);
+    assert_int_equal(stats.total_allocs, 0);
+
+
+    void *allocs[5];
+    for (int i=0; i<5; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK);
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.largest_gap, 500);
+    assert_int_equal((int) (stats.fragmentation * 1000), 285);
+    assert_int_equal(stats.gap_histogram[6], 2);
+    assert_int_equal(stats.gap_histogram[8], 1);
+    assert_int_equal(stats.gap_histogram[9], 0);
+    assert_int_equal(stats.peak_alloc_size, 500);
+    assert_int_equal(stats.peak_used_nodes, 6);
+    assert_int_equal(stats.total_allocs, 5);
+    assert_int_equal(stats.total_frees, 2);
+    assert_int_equal(stats.total_failures, 0);
+
+
+    assert_null(mem_new_alloc(pool, 800));
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.total_failures, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+    assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+    assert_int_equal(stats.largest_gap, 1000);
+    assert_int_equal((int) (stats.fragmentation * 1000), 0);
+    assert_int_equal(stats.gap_histogram[6], 0);
+    assert_int_equal(stats.gap_histogram[8], 0);
+    assert_int_equal(stats.gap_histogram[9], 1);
+    assert_int_equal(stats.peak_alloc_size, 500);
+    assert_int_equal(stats.peak_used_nodes, 6);
+    assert_int_equal(stats.total_allocs, 5);
+    assert_int_equal(stats.total_frees, 5);
+    assert_int_equal(stats.total_failures, 1);
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+
+
+    pool_pt slab = mem_slab_open(SLAB_OBJECT_SIZE, SLAB_COUNT);
+    assert_non_null(slab);
+    void *alloc0 = mem_new_alloc(slab, SLAB_OBJECT_SIZE);
+    void *alloc1 = mem_new_alloc(slab, SLAB_OBJECT_SIZE);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_int_equal(mem_del_alloc(slab, alloc0), ALLOC_OK);
+    assert_int_equal(mem_pool_stats(slab, &stats), ALLOC_OK);
+    assert_int_equal(stats.largest_gap, SLAB_OBJECT_SIZE);
+    assert_int_equal((int) (stats.fragmentation * 1000), 0);
+    assert_int_equal(stats.gap_histogram[5], SLAB_COUNT - 1);
+    assert_int_equal(stats.peak_alloc_size, 2 * SLAB_OBJECT_SIZE);
+    assert_int_equal(stats.total_allocs, 2);
+    assert_int_equal(stats.total_frees, 1);
+    assert_int_equal(mem_del_alloc(slab, alloc1), ALLOC_OK);
+    assert_int_equal(mem_pool_close(slab), ALLOC_OK);
+
+
+    for (int cached = 0; cached < 2; ++cached) {
+        pool = mem_pool_open(STATS_POOL_SIZE, FIRST_FIT);
+        assert_non_null(pool);
+        if (cached) {
+            assert_int_equal(mem_pool_set_thread_cache(pool, 4), ALLOC_OK);
+        } else {
+            assert_int_equal(mem_pool_set_quick_lists(pool, 4), ALLOC_OK);
+        }
+        alloc0 = mem_new_alloc(pool, 96);
+        assert_non_null(alloc0);
+        for (int i = 0; i < 100; ++i) {
+            alloc1 = mem_new_alloc(pool, 96);
+            assert_non_null(alloc1);
+            assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+        }
+        assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+        assert_int_equal(stats.total_allocs, 101);
+        assert_int_equal(stats.total_frees, 100);
+        assert_int_equal(pool->num_allocs - stats.cached_blocks, 1);
+        assert_int_equal(pool->alloc_size - stats.cached_size, 96);
+
+        assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+        assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+    }
+
+
+    // note: 128 is a subclass boundary, so TLSF takes a gap of 128 for it
+    alloc_policy classPolicies[2] = { SEGREGATED_FIT, TLSF };
+    for (int p = 0; p < 2; ++p) {
+        pool = mem_pool_open(STATS_POOL_SIZE, classPolicies[p]);
+        assert_non_null(pool);
+        for (int i=0; i<5; ++i) {
+            allocs[i] = mem_new_alloc(pool, 128);
+            assert_non_null(allocs[i]);
+        }
+        alloc0 = mem_new_alloc(pool, STATS_POOL_SIZE - 5 * 128);
+        assert_non_null(alloc0);
+        for (int i=0; i<5; i+=2) {
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+        }
+        assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+        assert_int_equal(stats.largest_gap, 128);
+        for (int i=0; i<5; i+=2) {
+            allocs[i] = mem_new_alloc(pool, 128);
+            assert_non_null(allocs[i]);
+            assert_int_equal(mem_pool_stats(pool, &stats), ALLOC_OK);
+            assert_int_equal(stats.largest_gap, (i < 4) ? 128 : 0);
+        }
+        assert_int_equal(mem_pool_reset(pool), ALLOC_OK);
+        assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+    }
+
+
+    // clean up
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***       27. STRESS TESTING            ***/
+/*******************************************/
+
+void test_pool_stresstest0(void **state) {
+    (void) state; /* unused */
+
+    const unsigned num_pools = 200;
+    const unsigned num_allocations = 1000;
+    const unsigned min_alloc_size = 10;
+    const unsigned pool_size =
+            (num_allocations / 2) *
+            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
+    assert_int_equal(pool_size, 5005000);
+
+
+    pool_pt pools[num_pools];
+    void *allocations[num_pools][num_allocations];
+
+    /*
+     * Testing dynamic reallocation of pool structures:
+     *
+     * 1. 200 pools of 5005000 each (many pools)
+     * 2. In each pool 1000 allocations of different sizes (many allocations)
+     * 3. In each pool 500 deallocations (many gaps)
+     */
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    // allocate pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // open pool
+        pools[pix] =
+                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
+        assert_non_null(pools[pix]);
+        // allocate pool
+        unsigned allocated = 0;
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            allocations[pix][aix] =
+                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
+            allocated += (aix + 1) * min_alloc_size;
+            if (!allocations[pix][aix]) {
+                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
+            }
+            assert_non_null(allocations[pix][aix]);
+        }
+
+        // delete every other allocation
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (aix % 2) {
+                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+                allocations[pix][aix] = NULL;
+            }
+        }
+    }
+
+    // delete pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // delete pool's allocations
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (allocations[pix][aix]) {
+                // delete allocation
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+            }
+        }
+        // close pool
+        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
+    }
+
+    // free store
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+
+/*******************************************/
+/***        28. DRIVER ROUTINE           ***/
+/*******************************************/
+
+int run_test_suite() {
+    const struct CMUnitTest tests[] = {
+            // General tests
+            cmocka_unit_test(test_pool_store_smoketest),
+            cmocka_unit_test(test_pool_smoketest),
+
+            cmocka_unit_test(test_pool_nonempty),
+
+            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+
+            // First-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+
+            // Best-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+
+            // Segregated-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario20, pool_sf_setup, pool_sf_teardown),
+
+            // TLSF tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario21, pool_tlsf_setup, pool_tlsf_teardown),
+
+            // Buddy tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario22, pool_buddy_setup, pool_buddy_teardown),
+
+            // Slab tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario23, pool_slab_setup, pool_slab_teardown),
+
+            // Arena and reset tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario24, pool_arena_setup, pool_arena_teardown),
+            cmocka_unit_test(test_pool_scenario25),
+
+            // Boundary-tag tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_tag_setup, pool_tag_teardown),
+
+            // Data pointer tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_bf_setup, pool_bf_teardown),
+
+            // Aligned allocation tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario28, pool_ff_setup, pool_ff_teardown),
+
+            // Reallocation tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario29, pool_ff_setup, pool_ff_teardown),
+
+            // Growable pool tests
+            cmocka_unit_test(test_pool_scenario30),
+
+#ifdef MEM_POOL_THREAD_SAFE
+            // Thread-safe pool tests
+            cmocka_unit_test(test_pool_scenario31),
+#endif
+
+            // Thread cache tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_ff_setup, pool_ff_teardown),
+
+#ifdef MEM_POOL_THREAD_SAFE
+            // Remote free tests
+            cmocka_unit_test(test_pool_scenario33),
+#endif
+
+            // Sharded pool tests
+            cmocka_unit_test(test_pool_scenario34),
+
+            // Pool store tests
+            cmocka_unit_test(test_pool_scenario35),
+
+            // Snapshot tests
+            cmocka_unit_test(test_pool_scenario36),
+
+            // Deferred free tests
+            cmocka_unit_test(test_pool_scenario37),
+
+            // Batch allocation tests
+            cmocka_unit_test(test_pool_scenario38),
+
+            // Batch free tests
+            cmocka_unit_test(test_pool_scenario39),
+
+            // Quick list tests
+            cmocka_unit_test(test_pool_scenario40),
+
+            // Compaction tests
+            cmocka_unit_test(test_pool_scenario41),
+
+            // Statistics tests
+            cmocka_unit_test(test_pool_scenario42),
 
             // Stress tests
             cmocka_unit_test(test_pool_stresstest0),